@@ -2,3 +2,55 @@ map = "maps/GDC1.txt"
 init_x = 14.7
 init_y = 14.24
 init_r = 0
+
+-- KLD-sampling: the number of particles is picked at every resample from the
+-- number of occupied (x, y, theta) histogram bins, between the min and max.
+kld_sampling = true
+num_particles_min = 20
+num_particles_max = 500
+kld_epsilon = 0.05
+kld_z = 2.33
+kld_bin_size_xy = 0.5
+kld_bin_size_angle = 0.35
+
+-- Global localization: particles spread uniformly over the free space of the
+-- map (cells between the min and max clearance from the nearest wall), and
+-- weighted with a coarse likelihood field sensor model until their spread
+-- drops below global_converged_spread.
+global_num_particles = 100000
+global_num_beams = 30
+global_field_resolution = 0.1
+global_min_clearance = 0.3
+global_max_clearance = 3.0
+global_std_dev = 0.2
+global_gamma = 0.1
+global_converged_spread = 0.5
+
+-- Beam sensor model. Returns more than sensor_dshort shorter or sensor_dlong
+-- longer than expected get a constant weight; returns beyond the max range
+-- get sensor_max_range_weight (0 ignores them). The model is evaluated through
+-- a table of (expected, observed) range bins of sensor_table_resolution.
+sensor_dshort = 0.5
+sensor_dlong = 0.5
+sensor_gamma = 0.8
+sensor_std_dev = 0.15
+sensor_max_range_weight = 0
+sensor_table_resolution = 0.02
+
+-- Pose hypotheses: particles are clustered into connected components of an
+-- (x, y) grid with cells of cluster_cell_size.
+cluster_cell_size = 0.5
+
+-- Predicted scan cache: particles whose laser poses fall in the same
+-- (x, y, theta) grid cell share one ray cast scan, computed from the center of
+-- the cell. Holds predicted_scan_cache_size scans, least recently used first
+-- out.
+predicted_scan_cache = true
+predicted_scan_cache_size = 4096
+predicted_scan_cache_resolution_xy = 0.05
+predicted_scan_cache_resolution_angle = 0.02
+
+-- Tiled maps: only the tiles within tiled_map_radius tiles of the robot's tile
+-- are kept in memory. The tile size is set when the map is tiled, and should
+-- be at least the laser's max range divided by tiled_map_radius.
+tiled_map_radius = 2
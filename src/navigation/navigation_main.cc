@@ -44,6 +44,7 @@
 #include "ros/ros.h"
 #include "shared/math/math_util.h"
 #include "shared/util/timer.h"
+#include "shared/util/trace.h"
 #include "shared/ros/ros_helpers.h"
 
 #include "navigation.h"
@@ -69,12 +70,17 @@ DEFINE_string(init_topic,
               "initialpose",
               "Name of ROS topic for initialization");
 DEFINE_string(map, "maps/GDC1.txt", "Name of vector map file");
+DEFINE_string(trace_file,
+              "",
+              "If set, record a trace of the callbacks to this file, to "
+              "convert with trace_converter");
 
 bool run_ = true;
 sensor_msgs::LaserScan last_laser_msg_;
 Navigation* navigation_ = nullptr;
 
 void LaserCallback(const sensor_msgs::LaserScan& msg) {
+  TRACE_SCOPE("LaserCallback");
   if (FLAGS_v > 0) {
     printf("Laser t=%f, dt=%f\n",
            msg.header.stamp.toSec(),
@@ -97,6 +103,7 @@ void LaserCallback(const sensor_msgs::LaserScan& msg) {
 }
 
 void OdometryCallback(const nav_msgs::Odometry& msg) {
+  TRACE_SCOPE("OdometryCallback");
   if (FLAGS_v > 0) {
     printf("Odometry t=%f\n", msg.header.stamp.toSec());
   }
@@ -125,6 +132,7 @@ void SignalHandler(int) {
 }
 
 void LocalizationCallback(const amrl_msgs::Localization2DMsg msg) {
+  TRACE_SCOPE("LocalizationCallback");
   if (FLAGS_v > 0) {
     printf("Localization t=%f\n", GetWallTime());
   }
@@ -148,12 +156,20 @@ int main(int argc, char** argv) {
   ros::Subscriber goto_sub =
       n.subscribe("/move_base_simple/goal", 1, &GoToCallback);
 
+  if (!FLAGS_trace_file.empty()) {
+    trace::SetThreadName("main");
+    trace::Start(FLAGS_trace_file);
+  }
   RateLoop loop(20.0);
   while (run_ && ros::ok()) {
     ros::spinOnce();
-    navigation_->Run();
+    {
+      TRACE_SCOPE("Run");
+      navigation_->Run();
+    }
     loop.Sleep();
   }
+  trace::Stop();
   delete navigation_;
   return 0;
 }
@@ -0,0 +1,74 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           beam_model_table.cc
+\brief          Precomputed lookup table of the laser beam sensor model
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "beam_model_table.h"
+
+namespace particle_filter {
+
+BeamModelTable::BeamModelTable() :
+    range_min_(0),
+    range_max_(0),
+    inv_resolution_(0),
+    num_bins_(0) {
+  memset(&params_, 0, sizeof(params_));
+}
+
+void BeamModelTable::Build(const BeamModelParams& params) {
+  if (!table_.empty() && memcmp(&params, &params_, sizeof(params)) == 0) {
+    return;
+  }
+  params_ = params;
+  range_min_ = params.range_min;
+  range_max_ = params.range_max;
+  inv_resolution_ = 1.0f / params.resolution;
+  num_bins_ = static_cast<int>(ceil(params.range_max * inv_resolution_)) + 1;
+  table_.resize(num_bins_ * (num_bins_ + 1));
+
+  const double variance = params.std_dev * params.std_dev;
+  const double short_weight = exp(-(params.dshort * params.dshort) / variance);
+  const double long_weight = exp(-(params.dlong * params.dlong) / variance);
+  for (int i = 0; i < num_bins_; ++i) {
+    const double expected = i * params.resolution;
+    float* row = &table_[i * (num_bins_ + 1)];
+    for (int j = 0; j < num_bins_; ++j) {
+      const double observed = j * params.resolution;
+      double weight;
+      if (observed < expected - params.dshort) {
+        weight = short_weight;
+      } else if (observed > expected + params.dlong) {
+        weight = long_weight;
+      } else {
+        const double delta = observed - expected;
+        weight = exp(-(delta * delta) / variance);
+      }
+      row[j] = params.gamma * weight;
+    }
+    row[num_bins_] = params.gamma * params.max_range_weight;
+  }
+}
+
+}  // namespace particle_filter
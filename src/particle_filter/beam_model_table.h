@@ -0,0 +1,89 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           beam_model_table.h
+\brief          Precomputed lookup table of the laser beam sensor model
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <algorithm>
+#include <vector>
+
+#ifndef SRC_BEAM_MODEL_TABLE_H_
+#define SRC_BEAM_MODEL_TABLE_H_
+
+namespace particle_filter {
+
+// Parameters of the beam sensor model.
+struct BeamModelParams {
+  // Observed ranges more than dshort shorter (e.g. unmapped obstacles) or
+  // dlong longer than expected all get the same, truncated weight.
+  float dshort;
+  float dlong;
+  // Scale of the weight of every beam.
+  float gamma;
+  // Standard deviation of the laser range measurements.
+  float std_dev;
+  // Weight of a beam that returned nothing, i.e. beyond range_max. Zero
+  // ignores such beams.
+  float max_range_weight;
+  // Size of the range bins of the table.
+  float resolution;
+  // Range limits of the laser.
+  float range_min;
+  float range_max;
+};
+
+// Table of the weight of a single beam, indexed by quantized (expected,
+// observed) range. Evaluating the beam model is then a single table read.
+class BeamModelTable {
+ public:
+  BeamModelTable();
+
+  // Rebuild the table for the given parameters, unless they are the ones it
+  // was last built for.
+  void Build(const BeamModelParams& params);
+
+  // Weight of a beam with the given expected and observed ranges. Observed
+  // ranges below range_min, and NaNs, have zero weight.
+  float Weight(float expected, float observed) const {
+    if (!(observed >= range_min_)) return 0;
+    const int i = std::min(static_cast<int>(expected * inv_resolution_ + 0.5f),
+                           num_bins_ - 1);
+    const int j = (observed > range_max_) ?
+        num_bins_ :
+        std::min(static_cast<int>(observed * inv_resolution_ + 0.5f),
+                 num_bins_ - 1);
+    return table_[i * (num_bins_ + 1) + j];
+  }
+
+ private:
+  BeamModelParams params_;
+  float range_min_;
+  float range_max_;
+  float inv_resolution_;
+  // Number of range bins, from 0 to range_max.
+  int num_bins_;
+  // Row per expected range bin, with a column per observed range bin and a
+  // last column for max range returns.
+  std::vector<float> table_;
+};
+
+}  // namespace particle_filter
+
+#endif   // SRC_BEAM_MODEL_TABLE_H_
@@ -0,0 +1,105 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           likelihood_field.cc
+\brief          Precomputed distance-to-nearest-wall grid
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/distance_transform.h"
+#include "shared/math/line2d.h"
+#include "likelihood_field.h"
+
+using distance_transform::kInf;
+using distance_transform::SquaredDistanceTransform2D;
+using Eigen::Vector2f;
+using geometry::line2f;
+using std::max;
+using std::vector;
+
+namespace particle_filter {
+
+LikelihoodField::LikelihoodField() :
+    origin_(0, 0),
+    resolution_(1),
+    width_(0),
+    height_(0),
+    max_distance_(0) {}
+
+void LikelihoodField::Build(const vector<line2f>& lines,
+                            float resolution,
+                            float margin) {
+  distance_.clear();
+  if (lines.empty()) return;
+
+  // Step 1: Size the grid to the bounding box of the map.
+  Vector2f box_min = lines[0].p0;
+  Vector2f box_max = lines[0].p0;
+  for (const line2f& l : lines) {
+    box_min = box_min.cwiseMin(l.p0).cwiseMin(l.p1);
+    box_max = box_max.cwiseMax(l.p0).cwiseMax(l.p1);
+  }
+  resolution_ = resolution;
+  origin_ = box_min - Vector2f(margin, margin);
+  width_ = static_cast<int>(ceil((box_max.x() - box_min.x() + 2 * margin) /
+                                 resolution_)) + 1;
+  height_ = static_cast<int>(ceil((box_max.y() - box_min.y() + 2 * margin) /
+                                  resolution_)) + 1;
+
+  // Step 2: Mark every cell that a map line passes through.
+  vector<double> sq_distance(width_ * height_, kInf);
+  for (const line2f& l : lines) {
+    const int num_steps =
+        static_cast<int>(ceil(2.0 * l.Length() / resolution_)) + 1;
+    for (int i = 0; i <= num_steps; ++i) {
+      const Vector2f p = l.p0 + (l.p1 - l.p0) * (static_cast<float>(i) /
+                                                 num_steps);
+      const int cx = static_cast<int>((p.x() - origin_.x()) / resolution_);
+      const int cy = static_cast<int>((p.y() - origin_.y()) / resolution_);
+      sq_distance[cy * width_ + cx] = 0;
+    }
+  }
+
+  // Step 3: Exact Euclidean distance transform.
+  SquaredDistanceTransform2D(width_, height_, &sq_distance);
+
+  distance_.resize(width_ * height_);
+  max_distance_ = 0;
+  for (size_t i = 0; i < distance_.size(); ++i) {
+    distance_[i] = resolution_ * sqrt(sq_distance[i]);
+    max_distance_ = max(max_distance_, distance_[i]);
+  }
+}
+
+void LikelihoodField::GetFreeCells(float min_clearance,
+                                   float max_clearance,
+                                   vector<int>* cells) const {
+  cells->clear();
+  for (size_t i = 0; i < distance_.size(); ++i) {
+    if (distance_[i] >= min_clearance && distance_[i] <= max_clearance) {
+      cells->push_back(i);
+    }
+  }
+}
+
+}  // namespace particle_filter
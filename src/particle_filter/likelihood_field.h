@@ -0,0 +1,93 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           likelihood_field.h
+\brief          Precomputed distance-to-nearest-wall grid
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <cmath>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/line2d.h"
+
+#ifndef SRC_LIKELIHOOD_FIELD_H_
+#define SRC_LIKELIHOOD_FIELD_H_
+
+namespace particle_filter {
+
+// Grid over the map holding the distance from every cell to the nearest map
+// line. Looking up a laser endpoint in the grid gives a cheap sensor model
+// (the "likelihood field" model) that needs no ray casting, which is what
+// makes weighting a very large number of particles feasible.
+class LikelihoodField {
+ public:
+  LikelihoodField();
+
+  // Rebuild the grid for the given map lines. The grid covers the bounding
+  // box of the lines, grown by margin on every side.
+  void Build(const std::vector<geometry::line2f>& lines,
+             float resolution,
+             float margin);
+
+  bool Empty() const { return distance_.empty(); }
+
+  // Distance from p to the nearest map line, rounded to the grid resolution.
+  // Points outside the grid return the largest distance in the grid.
+  float Distance(const Eigen::Vector2f& p) const {
+    const int cx = static_cast<int>(floor((p.x() - origin_.x()) / resolution_));
+    const int cy = static_cast<int>(floor((p.y() - origin_.y()) / resolution_));
+    if (cx < 0 || cy < 0 || cx >= width_ || cy >= height_) {
+      return max_distance_;
+    }
+    return distance_[cy * width_ + cx];
+  }
+
+  // Get the indices of all cells whose distance to the nearest map line is
+  // between min_clearance and max_clearance.
+  void GetFreeCells(float min_clearance,
+                    float max_clearance,
+                    std::vector<int>* cells) const;
+
+  // Location of the center of the cell with the given index.
+  Eigen::Vector2f CellCenter(int cell) const {
+    return origin_ + resolution_ * Eigen::Vector2f(
+        static_cast<float>(cell % width_) + 0.5f,
+        static_cast<float>(cell / width_) + 0.5f);
+  }
+
+  float resolution() const { return resolution_; }
+
+ private:
+  // Location of the corner of cell (0, 0).
+  Eigen::Vector2f origin_;
+  // Size of a grid cell.
+  float resolution_;
+  // Grid dimensions, in cells.
+  int width_;
+  int height_;
+  // Largest distance in the grid.
+  float max_distance_;
+  // Row-major distance of each cell to the nearest map line.
+  std::vector<float> distance_;
+};
+
+}  // namespace particle_filter
+
+#endif   // SRC_LIKELIHOOD_FIELD_H_
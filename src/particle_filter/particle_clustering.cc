@@ -0,0 +1,198 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           particle_clustering.cc
+\brief          Grouping of the particle cloud into pose hypotheses
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/math_util.h"
+#include "particle_clustering.h"
+#include "particle_set.h"
+
+using Eigen::Matrix3f;
+using Eigen::Vector2f;
+using Eigen::Vector3f;
+using std::pair;
+using std::vector;
+
+namespace {
+
+// Pack the grid cell indices into a single key.
+uint64_t CellKey(int64_t ix, int64_t iy) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(ix)) << 32) |
+      static_cast<uint32_t>(iy);
+}
+
+int FindRoot(vector<int>* parent_ptr, int i) {
+  vector<int>& parent = *parent_ptr;
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+void Union(vector<int>* parent, int i, int j) {
+  i = FindRoot(parent, i);
+  j = FindRoot(parent, j);
+  if (i < j) {
+    (*parent)[j] = i;
+  } else if (j < i) {
+    (*parent)[i] = j;
+  }
+}
+
+// Weighted sums of a cluster.
+struct ClusterSums {
+  ClusterSums() :
+      weight(0), sum_x(0), sum_y(0), sum_cos(0), sum_sin(0),
+      num_particles(0) {}
+  double weight;
+  double sum_x;
+  double sum_y;
+  double sum_cos;
+  double sum_sin;
+  int num_particles;
+};
+
+}  // namespace
+
+namespace particle_filter {
+
+void ClusterParticles(const ParticleSet& particles,
+                      float cell_size,
+                      int max_hypotheses,
+                      vector<PoseHypothesis>* hypotheses) {
+  hypotheses->clear();
+  const size_t n = particles.Size();
+  if (n == 0 || max_hypotheses <= 0) return;
+  const AlignedVector<double>& weights = particles.NormalizedWeights();
+  const double total_weight = particles.TotalWeight();
+  if (total_weight <= 0) return;
+
+  // Step 1: Sort the particles by grid cell.
+  vector<pair<uint64_t, int>> particle_cells(n);
+  vector<int64_t> cell_x(n);
+  vector<int64_t> cell_y(n);
+  for (size_t i = 0; i < n; ++i) {
+    cell_x[i] = static_cast<int64_t>(floor(particles.x[i] / cell_size));
+    cell_y[i] = static_cast<int64_t>(floor(particles.y[i] / cell_size));
+    particle_cells[i] = std::make_pair(CellKey(cell_x[i], cell_y[i]), i);
+  }
+  std::sort(particle_cells.begin(), particle_cells.end());
+
+  // Step 2: List the occupied cells, and the cell of each particle.
+  vector<uint64_t> cells;
+  vector<int> particle_cell(n);
+  vector<int> cell_particle;
+  for (size_t k = 0; k < n; ++k) {
+    if (cells.empty() || cells.back() != particle_cells[k].first) {
+      cells.push_back(particle_cells[k].first);
+      cell_particle.push_back(particle_cells[k].second);
+    }
+    particle_cell[particle_cells[k].second] = cells.size() - 1;
+  }
+
+  // Step 3: Union each occupied cell with its occupied neighbours. Looking at
+  // half of the 8 neighbours covers every adjacent pair once.
+  const int kNeighbours[4][2] = {{1, -1}, {1, 0}, {1, 1}, {0, 1}};
+  vector<int> parent(cells.size());
+  for (size_t c = 0; c < cells.size(); ++c) parent[c] = c;
+  for (size_t c = 0; c < cells.size(); ++c) {
+    const int p = cell_particle[c];
+    for (int k = 0; k < 4; ++k) {
+      const uint64_t neighbour = CellKey(cell_x[p] + kNeighbours[k][0],
+                                         cell_y[p] + kNeighbours[k][1]);
+      const vector<uint64_t>::const_iterator it =
+          std::lower_bound(cells.begin(), cells.end(), neighbour);
+      if (it != cells.end() && *it == neighbour) {
+        Union(&parent, c, it - cells.begin());
+      }
+    }
+  }
+
+  // Step 4: Number the clusters, and accumulate their weighted sums.
+  vector<int> cluster_of_root(cells.size(), -1);
+  vector<int> particle_cluster(n);
+  vector<ClusterSums> sums;
+  for (size_t i = 0; i < n; ++i) {
+    const int root = FindRoot(&parent, particle_cell[i]);
+    if (cluster_of_root[root] < 0) {
+      cluster_of_root[root] = sums.size();
+      sums.push_back(ClusterSums());
+    }
+    const int cluster = cluster_of_root[root];
+    particle_cluster[i] = cluster;
+    ClusterSums& s = sums[cluster];
+    const double w = weights[i];
+    s.weight += w;
+    s.sum_x += w * particles.x[i];
+    s.sum_y += w * particles.y[i];
+    s.sum_cos += w * cos(particles.angle[i]);
+    s.sum_sin += w * sin(particles.angle[i]);
+    ++s.num_particles;
+  }
+
+  // Step 5: Keep the heaviest clusters, and compute their means.
+  vector<pair<double, int>> order(sums.size());
+  for (size_t c = 0; c < sums.size(); ++c) {
+    order[c] = std::make_pair(-sums[c].weight, c);
+  }
+  const size_t num_hypotheses =
+      std::min(order.size(), static_cast<size_t>(max_hypotheses));
+  std::partial_sort(order.begin(), order.begin() + num_hypotheses,
+                    order.end());
+  vector<int> hypothesis_of_cluster(sums.size(), -1);
+  hypotheses->resize(num_hypotheses);
+  for (size_t h = 0; h < num_hypotheses; ++h) {
+    const ClusterSums& s = sums[order[h].second];
+    hypothesis_of_cluster[order[h].second] = h;
+    PoseHypothesis& hypothesis = (*hypotheses)[h];
+    hypothesis.loc = Vector2f(s.sum_x / s.weight, s.sum_y / s.weight);
+    hypothesis.angle = atan2(s.sum_sin, s.sum_cos);
+    hypothesis.weight = s.weight / total_weight;
+    hypothesis.covariance.setZero();
+    hypothesis.num_particles = s.num_particles;
+  }
+
+  // Step 6: Weighted covariances about the means.
+  for (size_t i = 0; i < n; ++i) {
+    const int h = hypothesis_of_cluster[particle_cluster[i]];
+    if (h < 0) continue;
+    PoseHypothesis& hypothesis = (*hypotheses)[h];
+    const Vector3f d(particles.x[i] - hypothesis.loc.x(),
+                     particles.y[i] - hypothesis.loc.y(),
+                     math_util::AngleDiff(particles.angle[i],
+                                          hypothesis.angle));
+    hypothesis.covariance += static_cast<float>(weights[i]) * d * d.transpose();
+  }
+  for (size_t h = 0; h < num_hypotheses; ++h) {
+    (*hypotheses)[h].covariance /= sums[order[h].second].weight;
+  }
+}
+
+}  // namespace particle_filter
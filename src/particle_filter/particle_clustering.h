@@ -0,0 +1,59 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           particle_clustering.h
+\brief          Grouping of the particle cloud into pose hypotheses
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "particle_set.h"
+
+#ifndef SRC_PARTICLE_CLUSTERING_H_
+#define SRC_PARTICLE_CLUSTERING_H_
+
+namespace particle_filter {
+
+// One mode of the particle distribution.
+struct PoseHypothesis {
+  // Weighted mean location and circular mean angle of the cluster.
+  Eigen::Vector2f loc;
+  float angle;
+  // Fraction of the total particle weight in the cluster.
+  double weight;
+  // Weighted covariance of (x, y, angle), with the angles taken relative to
+  // the mean angle.
+  Eigen::Matrix3f covariance;
+  // Number of particles in the cluster.
+  int num_particles;
+};
+
+// Group the particles into clusters: connected components of the occupied
+// cells of an (x, y) grid of the given cell size, with cells connected to
+// their 8 neighbours. Fills hypotheses with the max_hypotheses heaviest
+// clusters, heaviest first. Takes O(N log N) time for N particles.
+void ClusterParticles(const ParticleSet& particles,
+                      float cell_size,
+                      int max_hypotheses,
+                      std::vector<PoseHypothesis>* hypotheses);
+
+}  // namespace particle_filter
+
+#endif   // SRC_PARTICLE_CLUSTERING_H_
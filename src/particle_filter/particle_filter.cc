@@ -29,6 +29,8 @@
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include "eigen3/Eigen/Dense"
 #include "eigen3/Eigen/Geometry"
 #include "gflags/gflags.h"
@@ -39,6 +41,7 @@
 #include "shared/util/timer.h"
 #include "config_reader/config_reader.h"
 #include "particle_filter.h"
+#include "vector_map/map_cache.h"
 #include "vector_map/vector_map.h"
 #include <math.h>
 
@@ -47,34 +50,245 @@
 using geometry::line2f;
 using std::cout;
 using std::endl;
+using std::shared_ptr;
 using std::string;
 using std::swap;
 using std::vector;
 using Eigen::Vector2f;
 using Eigen::Vector2i;
+using vector_map::MapCache;
+using vector_map::TiledVectorMap;
 using vector_map::VectorMap;
 
 DEFINE_double(num_particles, 50, "Number of particles");
 
 namespace {
   int predict_steps {0};
-  double max_particle_weight {0};
   int updates_done {0};
   double distance_moved_over_predict {0};
+  int global_updates_done {0};
 }
 
 namespace particle_filter {
 
+// KLD-sampling parameters
+CONFIG_BOOL(kld_sampling_, "kld_sampling");
+CONFIG_INT(num_particles_min_, "num_particles_min");
+CONFIG_INT(num_particles_max_, "num_particles_max");
+CONFIG_FLOAT(kld_epsilon_, "kld_epsilon");
+CONFIG_FLOAT(kld_z_, "kld_z");
+CONFIG_FLOAT(kld_bin_size_xy_, "kld_bin_size_xy");
+CONFIG_FLOAT(kld_bin_size_angle_, "kld_bin_size_angle");
+
+// Global localization parameters
+CONFIG_INT(global_num_particles_, "global_num_particles");
+CONFIG_INT(global_num_beams_, "global_num_beams");
+CONFIG_FLOAT(global_field_resolution_, "global_field_resolution");
+CONFIG_FLOAT(global_min_clearance_, "global_min_clearance");
+CONFIG_FLOAT(global_max_clearance_, "global_max_clearance");
+CONFIG_FLOAT(global_std_dev_, "global_std_dev");
+CONFIG_FLOAT(global_gamma_, "global_gamma");
+CONFIG_FLOAT(global_converged_spread_, "global_converged_spread");
+
+// Beam sensor model parameters
+CONFIG_FLOAT(sensor_dshort_, "sensor_dshort");
+CONFIG_FLOAT(sensor_dlong_, "sensor_dlong");
+CONFIG_FLOAT(sensor_gamma_, "sensor_gamma");
+CONFIG_FLOAT(sensor_std_dev_, "sensor_std_dev");
+CONFIG_FLOAT(sensor_max_range_weight_, "sensor_max_range_weight");
+CONFIG_FLOAT(sensor_table_resolution_, "sensor_table_resolution");
+
+// Tiled map parameters
+CONFIG_INT(tiled_map_radius_, "tiled_map_radius");
+
+// Particle clustering parameters
+CONFIG_FLOAT(cluster_cell_size_, "cluster_cell_size");
+
+// Predicted scan cache parameters
+CONFIG_BOOL(predicted_scan_cache_, "predicted_scan_cache");
+CONFIG_INT(predicted_scan_cache_size_, "predicted_scan_cache_size");
+CONFIG_FLOAT(predicted_scan_cache_resolution_xy_,
+             "predicted_scan_cache_resolution_xy");
+CONFIG_FLOAT(predicted_scan_cache_resolution_angle_,
+             "predicted_scan_cache_resolution_angle");
+
 config_reader::ConfigReader config_reader_({"config/particle_filter.lua"});
 
+namespace {
+// Get the KLD-sampling parameters from the config, for the given maximum
+// number of particles.
+KldParams GetKldParams(int max_particles) {
+  KldParams kld_params;
+  kld_params.min_particles = CONFIG_num_particles_min_;
+  kld_params.max_particles = max_particles;
+  kld_params.epsilon = CONFIG_kld_epsilon_;
+  kld_params.z = CONFIG_kld_z_;
+  kld_params.bin_size_xy = CONFIG_kld_bin_size_xy_;
+  kld_params.bin_size_angle = CONFIG_kld_bin_size_angle_;
+  return kld_params;
+}
+}  // namespace
+
+// A map loaded in the background, and the request it was loaded for.
+struct LoadedMap {
+  int generation;
+  shared_ptr<const VectorMap> map;
+};
+
+// Loader threads publish the maps they load here, with atomic shared_ptr
+// stores, and the laser callback takes them with an atomic exchange.
+struct ParticleFilter::MapMailbox {
+  shared_ptr<const LoadedMap> ready;
+};
+
 ParticleFilter::ParticleFilter() :
+    map_mailbox_(std::make_shared<MapMailbox>()),
+    map_generation_(0),
+    map_pending_(false),
+    scan_cache_range_min_(0),
+    scan_cache_range_max_(0),
+    scan_cache_angle_min_(0),
+    scan_cache_angle_max_(0),
     odom_old_pos(0,0),
     odom_old_angle {0},
     odom_initialized_(false),
-    predict_step_done_(false) {}
+    predict_step_done_(false),
+    global_localization_(false) {}
 
 void ParticleFilter::GetParticles(vector<Particle>* particles) const {
-  *particles = particles_;
+  particles_.GetParticles(particles);
+}
+
+void ParticleFilter::SetMap(const shared_ptr<const VectorMap>& map) {
+  map_ = map;
+  scan_cache_.Clear();
+}
+
+void ParticleFilter::InstallPendingMap() {
+  // The tiled map publishes a new view whenever its resident tiles change
+  if (tiled_map_)
+  {
+    shared_ptr<const VectorMap> view = tiled_map_->GetView();
+    if (view && view != map_)
+    {
+      SetMap(view);
+      map_pending_ = false;
+    }
+    return;
+  }
+  if (!map_pending_)
+    return;
+  shared_ptr<const LoadedMap> loaded = std::atomic_exchange(
+      &map_mailbox_->ready, shared_ptr<const LoadedMap>());
+  // A map loaded for an older request is stale; the latest one is still on
+  // its way
+  if (loaded && loaded->generation == map_generation_)
+  {
+    SetMap(loaded->map);
+    map_pending_ = false;
+  }
+}
+
+void ParticleFilter::CastRays(const Vector2f& laser_scanner_loc,
+                              const float angle,
+                              int length_of_scan_vec,
+                              float range_min,
+                              float range_max,
+                              float angle_min,
+                              float angle_max,
+                              float* predicted_ranges)
+{
+  // Starting Angle based on the orientation of the laser (angle)
+  float parsed_angle = angle+angle_min;
+
+  // Loop through each theoretical scan, stepping the scan angle as we go
+  for (int j {0}; j < length_of_scan_vec; j++)
+  {
+    parsed_angle += ((angle_max-angle_min)/length_of_scan_vec);
+
+    // Initialize the points of the predicted laser scan rays
+    line2f laser_ray(1,2,3,4);
+    laser_ray.p0.x() = laser_scanner_loc.x() + range_min*cos(parsed_angle);
+    laser_ray.p0.y() = laser_scanner_loc.y() + range_min*sin(parsed_angle);
+    laser_ray.p1.x() = laser_scanner_loc.x() + range_max*cos(parsed_angle);
+    laser_ray.p1.y() = laser_scanner_loc.y() + range_max*sin(parsed_angle);
+
+    // Rays that hit nothing return the max range
+    double max_distance_of_current_ray = (laser_scanner_loc - laser_ray.p1).norm();
+
+    // Loop Through Each Line from Imported Map Text File to See this Single Laser Ray
+    // Intersects at the angle of parsed_angle
+    for (size_t k = 0; k < map_->lines.size(); ++k) 
+    {
+      // Assign Map Lines to Variable for Interestion Calculations
+      const line2f& map_line = map_->lines[k];
+      
+      // Initialize Return Variable of the Location where the Ray Intersects
+      Eigen::Vector2f intersection_point;
+
+      // Compare Map Text File Lines to Theoretical Laser Rays from Each Particle
+      bool intersects = map_line.Intersection(laser_ray, &intersection_point);
+      
+      if (intersects) // is true
+      {
+        // Record Distance of that Intersecting Ray
+        double distance_of_intersecting_ray = (intersection_point-laser_scanner_loc).norm();
+        // Keep the shortest distance of all of the intersections for this ray
+        if ( distance_of_intersecting_ray < max_distance_of_current_ray)
+          max_distance_of_current_ray = distance_of_intersecting_ray;
+      }
+    }
+    predicted_ranges[j] = max_distance_of_current_ray;
+  }
+}
+
+const float* ParticleFilter::GetPredictedRanges(const Vector2f& laser_scanner_loc,
+                                                const float angle,
+                                                int length_of_scan_vec,
+                                                float range_min,
+                                                float range_max,
+                                                float angle_min,
+                                                float angle_max)
+{
+  // Without the cache, ray cast from the exact pose
+  if (!CONFIG_predicted_scan_cache_)
+  {
+    predicted_ranges_.resize(length_of_scan_vec);
+    CastRays(laser_scanner_loc, angle, length_of_scan_vec,
+             range_min, range_max, angle_min, angle_max,
+             predicted_ranges_.data());
+    return predicted_ranges_.data();
+  }
+
+  // The cached scans are only valid for one set of scan parameters
+  if (length_of_scan_vec != scan_cache_.num_ranges() or
+      range_min != scan_cache_range_min_ or range_max != scan_cache_range_max_ or
+      angle_min != scan_cache_angle_min_ or angle_max != scan_cache_angle_max_)
+  {
+    scan_cache_.Clear();
+    scan_cache_range_min_ = range_min;
+    scan_cache_range_max_ = range_max;
+    scan_cache_angle_min_ = angle_min;
+    scan_cache_angle_max_ = angle_max;
+  }
+  scan_cache_.Configure(CONFIG_predicted_scan_cache_resolution_xy_,
+                        CONFIG_predicted_scan_cache_resolution_angle_,
+                        CONFIG_predicted_scan_cache_size_,
+                        length_of_scan_vec);
+
+  // Look up the scan of the center of this pose's grid cell, ray casting it
+  // on a miss
+  Vector2f center_loc;
+  float center_angle;
+  const uint64_t key = scan_cache_.Quantize(laser_scanner_loc, angle,
+                                            &center_loc, &center_angle);
+  const float* cached_ranges = scan_cache_.Find(key);
+  if (cached_ranges != NULL)
+    return cached_ranges;
+  float* new_ranges = scan_cache_.Insert(key);
+  CastRays(center_loc, center_angle, length_of_scan_vec,
+           range_min, range_max, angle_min, angle_max, new_ranges);
+  return new_ranges;
 }
 
 void ParticleFilter::GetPredictedPointCloud(const Vector2f& loc,
@@ -95,11 +309,12 @@ void ParticleFilter::GetPredictedPointCloud(const Vector2f& loc,
   // Setting Up Output Vector
   vector<Vector2f>& scan = *scan_ptr;
 
-  // Note: The returned values must be set using the `scan` variable:
-  scan.resize(num_ranges);
-  
-  // Initialize Max Distance Point Vector
-  Eigen::Vector2f endpoint_of_max_distance_ray;
+  // Nothing to predict until the map has been loaded
+  if (!map_)
+  {
+    scan.clear();
+    return;
+  }
 
   // Step Size of Scan; set_parameter
   int step_size_of_scan {110}; // 75 best guess
@@ -112,69 +327,21 @@ void ParticleFilter::GetPredictedPointCloud(const Vector2f& loc,
 
   // Step 1: Predict Beginning and End Points of Each Ray within Theoretical Laser Scan
   // Points for Laser Scanner in Space using Distance between baselink and laser scanner on physical robot to be 0.2 meters
-  float laser_scanner_loc_x = loc.x() + 0.2*cos(angle);
-  float laser_scanner_loc_y = loc.y() + 0.2*sin(angle);
-  Eigen::Vector2f laser_scanner_loc(laser_scanner_loc_x,laser_scanner_loc_y);
+  Eigen::Vector2f laser_scanner_loc(loc.x() + 0.2*cos(angle),
+                                    loc.y() + 0.2*sin(angle));
 
-  // Starting Angle based on the orientation of the particle (angle)
-  float parsed_angle = angle+angle_min;
-
-  // Build Vector of Laser Scan Angles
-  std::vector <float> predicted_scan_angles;
-
-  // Step 2: Fill a Vector of each Scan Angle
-  for (int i {0}; i < length_of_scan_vec; i++)
-  {
-    parsed_angle += ((angle_max-angle_min)/length_of_scan_vec);
-    predicted_scan_angles.push_back(parsed_angle);
-  }
+  // Step 2: Get the range of each ray, from the cache if enabled
+  const float* predicted_ranges = GetPredictedRanges(
+      laser_scanner_loc, angle, length_of_scan_vec,
+      range_min, range_max, angle_min, angle_max);
 
-  // Step 3: loop through each theoretical scan
+  // Step 3: Fill Output Vector with the point where each ray hits the map
+  float parsed_angle = angle+angle_min;
   for (int j {0}; j < length_of_scan_vec; j++)
   {
-    // Initialize the points of the predicted laser scan rays
-    line2f laser_ray(1,2,3,4);
-    laser_ray.p0.x() = laser_scanner_loc_x + range_min*cos(predicted_scan_angles[j]);
-    laser_ray.p0.y() = laser_scanner_loc_y + range_min*sin(predicted_scan_angles[j]);
-    laser_ray.p1.x() = laser_scanner_loc_x + range_max*cos(predicted_scan_angles[j]);
-    laser_ray.p1.y() = laser_scanner_loc_y + range_max*sin(predicted_scan_angles[j]);
-    
-    // Fill i-th entry to return vector (scan) with each point of predicted laser scan of the max range
-    scan[j] << laser_ray.p1.x(),
-               laser_ray.p1.y();
-    
-    // Calculate the max distance of the current ray
-    double max_distance_of_current_ray = (laser_scanner_loc - scan[j]).norm();
-
-    // Loop Through Each Line from Imported Map Text File to See this Single Laser Ray
-    // Intersects at the angle of predicted_scan_angles
-    for (size_t k = 0; k < map_.lines.size(); ++k) 
-    {
-      // Assign Map Lines to Variable for Interestion Calculations
-      const line2f map_line = map_.lines[k];
-      
-      // Initialize Return Variable of the Location where the Ray Intersects
-      Eigen::Vector2f intersection_point;
-
-      // Compare Map Text File Lines to Theoretical Laser Rays from Each Particle
-      bool intersects = map_line.Intersection(laser_ray, &intersection_point);
-      
-      if (intersects) // is true
-      {
-        // Record Distance of that Intersecting Ray
-        double distance_of_intersecting_ray = (intersection_point-laser_scanner_loc).norm();
-        // If the Intersecting Distance Recorded above is less than of all of the previously recorded intersections for this ray at specific angele
-        if ( distance_of_intersecting_ray < max_distance_of_current_ray)
-        {
-          // Set Distance Variable for Next Comparison
-          max_distance_of_current_ray = distance_of_intersecting_ray;
-          // Record the Endpoint of Where that Ray Intersects
-          endpoint_of_max_distance_ray = intersection_point;
-        }
-      }
-    }
-    // Fill Output Vector of this Ray with the point at where the shortest distance ray intersects with the map
-    scan[j] = endpoint_of_max_distance_ray; 
+    parsed_angle += ((angle_max-angle_min)/length_of_scan_vec);
+    scan[j] = laser_scanner_loc + predicted_ranges[j] *
+        Vector2f(cos(parsed_angle), sin(parsed_angle));
   }
 }
 
@@ -188,126 +355,129 @@ void ParticleFilter::Update(const vector<float>& ranges,
   // Setting Up Output Variable
   Particle& particle = *p_ptr;
 
-  // Initialize point cloud vector to fill from GetPredictedPointCloud
-  vector<Vector2f> predicted_point_cloud;
-
-  // Fill point cloud vector
-  GetPredictedPointCloud(particle.loc, particle.angle, 
-                         ranges.size(), range_min, range_max, 
-                         angle_min, angle_max, &predicted_point_cloud);
-
-  // Resize lidar scan range (Number of Rays)
-  vector<float> resized_ranges(predicted_point_cloud.size());
-  int lidar_ray_step_size = ranges.size() / predicted_point_cloud.size();
-
-  // Calculating the Size of Predicted Point Cloud Length
-  int predicted_point_cloud_length = predicted_point_cloud.size();
-
-  // Resizing the Actual Laser Scan Ranges
-  for(int i = 0; i < predicted_point_cloud_length; i++)
-    resized_ranges[i] = ranges[lidar_ray_step_size*i];
-
-  // Tuning parameters for the minimum and maximum distances of the laser scanner; set_parameter
-  double dshort = 0.5;
-  double dlong = 0.5;
-  double gamma = 0.8;
-
-  // Standard deviation of Physical LIDAR System; set_parameter
-  double ray_std_dev = 0.15;
-
-  // Reset variables between each input point cloud
-  float weight {0};
-  float total_weight {0};
+  // Step Size of Scan, as in GetPredictedPointCloud; set_parameter
+  int step_size_of_scan {110};
+  int predicted_point_cloud_length = ranges.size() / step_size_of_scan;
+  if (predicted_point_cloud_length == 0)
+    return;
 
-  // Calculate Weight for Particle
+  // Physical Laser Scanner Location is Offset From the Particle Location
+  const Vector2f laser_scanner_loc(particle.loc.x() + 0.2*cos(particle.angle),
+                                   particle.loc.y() + 0.2*sin(particle.angle));
+
+  // Predicted range of each ray, from the cache if enabled
+  const float* predicted_ranges = GetPredictedRanges(
+      laser_scanner_loc, particle.angle, predicted_point_cloud_length,
+      range_min, range_max, angle_min, angle_max);
+
+  // Step through the lidar scan ranges to match the predicted rays
+  int lidar_ray_step_size = ranges.size() / predicted_point_cloud_length;
+
+  // Weight of each beam from the precomputed beam model table, rebuilt if the
+  // config or the laser range limits change
+  BeamModelParams beam_model_params;
+  beam_model_params.dshort = CONFIG_sensor_dshort_;
+  beam_model_params.dlong = CONFIG_sensor_dlong_;
+  beam_model_params.gamma = CONFIG_sensor_gamma_;
+  beam_model_params.std_dev = CONFIG_sensor_std_dev_;
+  beam_model_params.max_range_weight = CONFIG_sensor_max_range_weight_;
+  beam_model_params.resolution = CONFIG_sensor_table_resolution_;
+  beam_model_params.range_min = range_min;
+  beam_model_params.range_max = range_max;
+  beam_model_table_.Build(beam_model_params);
+
+  // Calculate Weight for Particle, accumulated in double as it is used as the
+  // particle's log weight
+  double total_weight {0};
   for(int i = 0; i < predicted_point_cloud_length; i++)
-  {
-    // Physical Laser Scanner Location is Offset From the Particle Location
-    float laser_scanner_loc_x = particle.loc.x() + 0.2*cos(particle.angle);
-    float laser_scanner_loc_y = particle.loc.y() + 0.2*sin(particle.angle);
-
-    // Distance laser scanner actually found from obstacle (ACTUAL)
-    float particle_actual_distance = resized_ranges[i];
+    total_weight += beam_model_table_.Weight(predicted_ranges[i],
+                                             ranges[lidar_ray_step_size*i]);
 
-    // Calculate distance between the laser scanner and the returned point cloud location (THEORETICAL)
-    float theoretical_dist_x = predicted_point_cloud[i].x() - laser_scanner_loc_x;
-    float theoretical_dist_y = predicted_point_cloud[i].y() - laser_scanner_loc_y;
-    float particle_theoretical_distance = sqrt(pow(theoretical_dist_x, 2)+pow(theoretical_dist_y, 2));
-
-    // Calculating Distance Comparison
-    float delta_distance = particle_actual_distance - particle_theoretical_distance;
-
-    // (MAIN WEIGHT FUNCTION) Function for weighting the probability of each particle being in the location found
-    if(particle_actual_distance < range_min or particle_actual_distance > range_max)
-      continue;
-    else if (particle_actual_distance < (particle_theoretical_distance - dshort))
-      weight = exp(-(pow(dshort,2) / pow(ray_std_dev,2)));
-    else if (particle_actual_distance > (particle_theoretical_distance + dlong))
-      weight = exp(-(pow(dlong,2) / pow(ray_std_dev,2)));
-    else
-      weight = exp(-(pow(delta_distance,2) / pow(ray_std_dev,2)));
-
-    // Update Total Probability for this particle
-    total_weight += weight;
-  }
-
-  // Set particle weight to a scaled total weight for tuning. Gamma set at begginning of method.
-  particle.weight = gamma * total_weight;
+  // Set particle log weight to the total weight, already scaled by gamma.
+  particle.weight = total_weight;
 }
 
 void ParticleFilter::Resample() {
   // Resample the particles, proportional to their weights.
   // The current particles are in the `particles_` variable.
 
-  // **** Low Variance Resampling Method **** 
-  
-  // Reset
-  int num_of_resamples {0}; 
-
-  // Predefine the Number of Resamples based on number of particles; set_parameter
-  num_of_resamples = particles_.size();
-
-  // Initializations
-  std::vector <Particle> reduced_particle_vec;      // return vector (vector of the kept particles)
-  std::vector <double> norm_particle_weight;        // norm particle vec
-  std::vector <double> bin_edges(num_of_resamples); // vector for low variance resample bins   
-  double total_weight {0};                          // total weight of all particles
-  int input_vec_length = particles_.size();         // Get Length of Input Vector for Looping
-
-  // Step 1: Normalize Particle Weights
-  // Repopulate the weights with normalized weights (Reference 51:00 min in 2021.09.22 Lecture)
-  for (int k {0}; k < input_vec_length; k++)
+  // **** KLD-Sampling, or Low Variance Resampling Method ****
+  // Both leave the particles with uniform weights
+  if (CONFIG_kld_sampling_)
   {
-    norm_particle_weight.push_back(abs(exp(particles_[k].weight - max_particle_weight)));
-    total_weight += norm_particle_weight[k];
-    bin_edges[k] = total_weight;
+    particles_.ResampleKld(GetKldParams(CONFIG_num_particles_max_), &rng_);
   }
+  else
+  {
+    particles_.Resample(&rng_);
+  }
+}
 
-  // Step 2: Draw A Random Number
-  // get equidistant location for low variance resample
-  float equidistant_loc = total_weight/num_of_resamples;
-
-  // Check to ensure update was run
-  if (equidistant_loc == 0)
+void ParticleFilter::UpdateGlobal(const vector<float>& ranges,
+                                  float range_min,
+                                  float range_max,
+                                  float angle_min,
+                                  float angle_max) {
+  const int num_ranges = ranges.size();
+  if (num_ranges == 0)
     return;
-  
-  // Get a random number
-  float random_num = rng_.UniformRandom(0, equidistant_loc);
 
-  // Step 3: Low Variance Resample Method, starting from first bin
-  for (int m {0}; m < num_of_resamples; m++)
+  // Use a subset of the beams, as their endpoints in the laser frame
+  const int beam_step = std::max(1, num_ranges / CONFIG_global_num_beams_);
+  const float angle_increment = (angle_max - angle_min) / num_ranges;
+  vector<Vector2f>& beam_endpoints = global_beam_endpoints_;
+  beam_endpoints.clear();
+  for (int i = 0; i < num_ranges; i += beam_step)
+  {
+    if (ranges[i] <= range_min or ranges[i] >= range_max)
+      continue;
+    const float beam_angle = angle_min + i * angle_increment;
+    beam_endpoints.push_back(
+        ranges[i] * Vector2f(cos(beam_angle), sin(beam_angle)));
+  }
+
+  // Distances beyond 3 standard deviations are all equally unlikely, so a
+  // single bad beam cannot rule out the right pose
+  const float max_distance = 3 * CONFIG_global_std_dev_;
+  const float inv_variance = 1.0 / Sq(CONFIG_global_std_dev_);
+
+  const size_t num_particles = particles_.Size();
+  particles_.ResetMaxLogWeight();
+  for (size_t i = 0; i < num_particles; ++i)
   {
-    while (bin_edges[m] > random_num)
+    // Physical Laser Scanner Location is Offset From the Particle Location
+    const float c = cos(particles_.angle[i]);
+    const float s = sin(particles_.angle[i]);
+    const Vector2f laser_scanner_loc(particles_.x[i] + 0.2 * c,
+                                     particles_.y[i] + 0.2 * s);
+
+    // Sum the log likelihoods of the beam endpoints in the map frame
+    float log_likelihood = 0;
+    for (const Vector2f& e : beam_endpoints)
     {
-      reduced_particle_vec.push_back(particles_[m]);
-      random_num += equidistant_loc;
+      const Vector2f p = laser_scanner_loc +
+          Vector2f(c * e.x() - s * e.y(), s * e.x() + c * e.y());
+      const float d = std::min(likelihood_field_.Distance(p), max_distance);
+      log_likelihood -= d * d * inv_variance;
     }
+    particles_.SetLogWeight(i, CONFIG_global_gamma_ * log_likelihood);
   }
+}
 
-  // Step 4: Reset Variables and Set New Particle Weights to output Particle Vector
-  max_particle_weight = 0;
-  particles_.clear();
-  particles_ = reduced_particle_vec;
+void ParticleFilter::ResampleGlobal() {
+  // Once the particles are close enough together, contract to the normal
+  // tracking budget and switch to the full sensor model
+  const float spread = particles_.GetLocationSpread();
+  if (spread < CONFIG_global_converged_spread_)
+  {
+    printf("Global localization converged, spread %f m\n", spread);
+    global_localization_ = false;
+    particles_.ResampleKld(GetKldParams(CONFIG_num_particles_max_), &rng_);
+  }
+  else
+  {
+    particles_.ResampleKld(GetKldParams(CONFIG_global_num_particles_), &rng_);
+  }
 }
 
 void ParticleFilter::ObserveLaser(const vector<float>& ranges,
@@ -319,22 +489,51 @@ void ParticleFilter::ObserveLaser(const vector<float>& ranges,
   // A new laser scan observation is available (in the laser frame)
   // Call the Update and Resample steps as necessary.
 
-  // Check to make sure particles are populated and odom is initialized
-  if (particles_.empty() || odom_initialized_ == false)
+  // Keep the tiles of a tiled map around the current estimate, and switch to
+  // a map loaded in the background, if one is ready, without waiting for the
+  // loader
+  if (tiled_map_ && !particles_.Empty())
+  {
+    Vector2f loc(0, 0);
+    float angle = 0;
+    particles_.GetLocation(&loc, &angle);
+    tiled_map_->Update(loc);
+  }
+  InstallPendingMap();
+
+  // Check to make sure the map is loaded, particles are populated, and odom is
+  // initialized
+  if (!map_ || map_pending_ || particles_.Empty() || odom_initialized_ == false)
     return;
 
+  // Global localization: update on the first scan, and then every time the
+  // robot has moved far enough; set_parameter
+  if (global_localization_)
+  {
+    if (global_updates_done == 0 or
+        (predict_steps >= 1 and distance_moved_over_predict > 0.1))
+    {
+      UpdateGlobal(ranges, range_min, range_max, angle_min, angle_max);
+      ResampleGlobal();
+      predict_steps = 0;
+      distance_moved_over_predict = 0;
+      global_updates_done++;
+    }
+    return;
+  }
+
   // Call Update Every n'th Predict; set_parameter
   if (predict_steps >= 1 and distance_moved_over_predict > 0.01)
   {
-    for(auto &particle : particles_)
+    // The particle set tracks the max log weight as the weights are set
+    particles_.ResetMaxLogWeight();
+    for (size_t i = 0; i < particles_.Size(); ++i)
     {
       // Call to Update
+      Particle particle = particles_.Get(i);
       Update(ranges, range_min, range_max, angle_min, angle_max, &particle);
-
-      // Update Max Log Particle Weight Based On Return from Update
-      if (particle.weight > max_particle_weight)
-        max_particle_weight = particle.weight;
-    } 
+      particles_.SetLogWeight(i, particle.weight);
+    }
 
     // Call Resample Every n'th Update; set_parameter
     if(updates_done == 7)
@@ -357,11 +556,6 @@ void ParticleFilter::Predict(const Eigen::Vector2f &odom_cur_pos, const float &o
 
   // Reference CS393r Lecture Slides "06 - Particle Filters" Slides 26 & 27
 
-  // Capture Length of Particle Vector
-  int particle_vector_length = particles_.size();
-  Eigen::Vector2f variance;
-  float variance_angle;
-
   // // Variance Parameters, set_parameter
   double a1 = 0.4;  // 0.08 // angle 
   double a2 = 0.1;  //0.01; // angle 
@@ -376,26 +570,19 @@ void ParticleFilter::Predict(const Eigen::Vector2f &odom_cur_pos, const float &o
   // (MAIN FUNCTION) Calculate Variance and Predict Particles Forward
   if (odom_initialized_ and delT_baselink.norm() < 1)
   {
-    for (int i {0}; i < particle_vector_length; i++) 
-    {   
-        // Rotate from Baselink frame to Map frame
-        Eigen::Vector2f delT_map = Eigen::Rotation2Df(particles_[i].angle)*delT_baselink;
-
-        // Add Variance to deltas
-        variance.x() = rng_.Gaussian(0, ( a1*delT_map.norm()+ a2*abs(delAngle_baselink) )); 
-        variance.y() = rng_.Gaussian(0, ( a1*delT_map.norm() + a2*abs(delAngle_baselink) )); 
-        variance_angle = rng_.Gaussian(0, ( a3*delT_map.norm() + a4*abs(delAngle_baselink) )); 
-
-        // Update Particle Location
-        particles_[i].loc += delT_map + variance;
-
-        // Update Particle Angle
-        particles_[i].angle += delAngle_baselink + variance_angle;
-        
-        // Set current odom values to previous values for next call to predict
-        odom_old_pos = odom_cur_pos;
-        odom_old_angle = odom_cur_angle;
-    }
+    // The translation has the same length in the map frame as in the
+    // baselink frame, so the noise is the same for every particle.
+    const float trans_std_dev = a1*delT_baselink.norm() + a2*fabs(delAngle_baselink);
+    const float angle_std_dev = a3*delT_baselink.norm() + a4*fabs(delAngle_baselink);
+
+    // Rotate each particle's translation to the map frame, add noise, and
+    // update its location and angle
+    particles_.Predict(delT_baselink, delAngle_baselink,
+                       trans_std_dev, angle_std_dev, &rng_);
+
+    // Set current odom values to previous values for next call to predict
+    odom_old_pos = odom_cur_pos;
+    odom_old_angle = odom_cur_angle;
 
     // Make sure we moved a large enough distance to control update
     distance_moved_over_predict += delT_baselink.norm(); 
@@ -419,17 +606,56 @@ void ParticleFilter::Initialize(const string& map_file,
   // was received from the log. Initialize the particles accordingly, e.g. with
   // some distribution around the provided location and angle.
 
-  // Load Desired Map
-  map_.Load(map_file);
+  // Use the desired map straight away if it is cached. Otherwise load it on a
+  // background thread, and publish it for ObserveLaser to pick up, so that
+  // the callback that asked for it is not blocked by the load
+  const int generation = ++map_generation_;
+  tiled_map_.reset();
+  const bool tiled = vector_map::IsTiledMap(map_file);
+  shared_ptr<const VectorMap> map;
+  if (!tiled)
+    map = MapCache::Instance().Find(map_file);
+  if (tiled)
+  {
+    // Tiled maps are streamed in around the robot from the start; the first
+    // view is ready once the tiles around loc have been loaded
+    map_pending_ = true;
+    tiled_map_.reset(new TiledVectorMap());
+    if (tiled_map_->Open(map_file, CONFIG_tiled_map_radius_))
+      tiled_map_->Update(loc);
+  }
+  else if (map)
+  {
+    SetMap(map);
+    map_pending_ = false;
+  }
+  else
+  {
+    map_pending_ = true;
+    shared_ptr<MapMailbox> mailbox = map_mailbox_;
+    std::thread([mailbox, map_file, generation]() {
+      shared_ptr<const LoadedMap> loaded(new LoadedMap{
+          generation, MapCache::Instance().Load(map_file)});
+      // Don't replace a map loaded for a newer request
+      shared_ptr<const LoadedMap> current = std::atomic_load(&mailbox->ready);
+      while ((!current || current->generation < generation) &&
+             !std::atomic_compare_exchange_weak(&mailbox->ready, &current,
+                                                loaded)) {}
+    }).detach();
+  }
 
-  // Clear out particle vector to start fresh
-  particles_.clear();
+  // Clear out particle vector to start fresh, with room for as many
+  // particles as resampling can produce
+  particles_.Clear();
+  particles_.Reserve(std::max<int>(FLAGS_num_particles,
+                                   CONFIG_num_particles_max_));
 
   // Initialize Variables
   Particle init_particle_cloud;
   odom_initialized_ = true;
+  global_localization_ = false;
   predict_steps = 1;
-  int num_of_init_particle_cloud = 50;  // set_parameter; number of particles to initialize with
+  int num_of_init_particle_cloud = FLAGS_num_particles;  // number of particles to initialize with
 
   // Create Random Particles based on zero mean Gaussian; set_parameter
   for(int i {0}; i < num_of_init_particle_cloud; i++){
@@ -437,11 +663,66 @@ void ParticleFilter::Initialize(const string& map_file,
     init_particle_cloud.loc.y() = loc.y() + rng_.Gaussian(0.0, 0.5);
     init_particle_cloud.angle = angle + rng_.Gaussian(0.0, 0.1);
     init_particle_cloud.weight = 0;
-    particles_.push_back(init_particle_cloud);
+    particles_.PushBack(init_particle_cloud);
   }
 
 }
 
+void ParticleFilter::InitializeGlobal(const string& map_file) {
+  // Load Desired Map, and the distances to its walls for the coarse sensor
+  // model. This needs the map straight away, so load it here; maps being
+  // loaded in the background for earlier requests are dropped
+  ++map_generation_;
+  tiled_map_.reset();
+  if (vector_map::IsTiledMap(map_file))
+  {
+    map_pending_ = true;
+    particles_.Clear();
+    fprintf(stderr, "ERROR: Global localization needs the whole map, and %s "
+            "is tiled\n", map_file.c_str());
+    return;
+  }
+  map_pending_ = false;
+  SetMap(MapCache::Instance().Load(map_file));
+  likelihood_field_.Build(map_->lines, CONFIG_global_field_resolution_, 1.0);
+
+  // Find the free space of the map
+  vector<int> free_cells;
+  likelihood_field_.GetFreeCells(CONFIG_global_min_clearance_,
+                                 CONFIG_global_max_clearance_,
+                                 &free_cells);
+  particles_.Clear();
+  particles_.Reserve(std::max(CONFIG_global_num_particles_,
+                              CONFIG_num_particles_max_));
+  if (free_cells.empty())
+  {
+    fprintf(stderr, "ERROR: No free space for global localization in %s\n",
+            map_file.c_str());
+    return;
+  }
+
+  // Initialize Variables
+  odom_initialized_ = true;
+  global_localization_ = true;
+  global_updates_done = 0;
+  predict_steps = 1;
+  distance_moved_over_predict = 0;
+
+  // Spread the particles uniformly over the free space, with uniform angles
+  const float half_cell = 0.5 * likelihood_field_.resolution();
+  const int num_particles = CONFIG_global_num_particles_;
+  particles_.Resize(num_particles);
+  for (int i = 0; i < num_particles; ++i)
+  {
+    const int cell = free_cells[rng_.RandomInt<int>(0, free_cells.size() - 1)];
+    const Vector2f center = likelihood_field_.CellCenter(cell);
+    particles_.x[i] = center.x() + rng_.UniformRandom(-half_cell, half_cell);
+    particles_.y[i] = center.y() + rng_.UniformRandom(-half_cell, half_cell);
+    particles_.angle[i] = rng_.UniformRandom(-M_PI, M_PI);
+    particles_.SetLogWeight(i, 0);
+  }
+}
+
 void ParticleFilter::GetLocation(Eigen::Vector2f* loc_ptr, 
                                  float* angle_ptr) const {
   Vector2f& loc = *loc_ptr;
@@ -454,36 +735,15 @@ void ParticleFilter::GetLocation(Eigen::Vector2f* loc_ptr,
 
   if (odom_initialized_ == true)
   {
-    // Initialize Variables
-    double sum_x {0};
-    double sum_y {0};
-    double sum_cos_theta {0};
-    double sum_sin_theta {0};
-    double total_particle_weight {0};
-
-    // Summations for all variables
-    for (auto particles:particles_)
-    {
-      // Normalize Particle Weights
-      double particle_norm_weight = abs(exp(particles.weight - max_particle_weight));
-
-      // Add All Normalized Particle Weights
-      total_particle_weight += particle_norm_weight;
-
-      // Calculate Numertors for Output location
-      sum_x += particles.loc.x() * particle_norm_weight;
-      sum_y += particles.loc.y() * particle_norm_weight;
-      sum_cos_theta += cos(particles.angle) * particle_norm_weight;
-      sum_sin_theta += sin(particles.angle) * particle_norm_weight;
-      
-    }
-
-    // (BEST ROBOT LOCATION ESTIMATE) Averages for x, y, and theta;
-    loc.x() = sum_x/total_particle_weight;
-    loc.y() = sum_y/total_particle_weight;
-    angle = atan2(sum_sin_theta/total_particle_weight,sum_cos_theta/total_particle_weight);
+    // (BEST ROBOT LOCATION ESTIMATE) Weighted averages for x, y, and theta;
+    particles_.GetLocation(&loc, &angle);
   }
 }
 
+void ParticleFilter::GetPoseHypotheses(
+    int max_hypotheses, vector<PoseHypothesis>* hypotheses) const {
+  ClusterParticles(particles_, CONFIG_cluster_cell_size_, max_hypotheses,
+                   hypotheses);
+}
 
-}  // namespace particle_filter
\ No newline at end of file
+}  // namespace particle_filter
@@ -24,26 +24,27 @@
 //========================================================================
 
 #include <algorithm>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "eigen3/Eigen/Dense"
 #include "eigen3/Eigen/Geometry"
 #include "shared/math/line2d.h"
 #include "shared/util/random.h"
+#include "vector_map/tiled_map.h"
 #include "vector_map/vector_map.h"
+#include "beam_model_table.h"
+#include "likelihood_field.h"
+#include "particle_clustering.h"
+#include "particle_set.h"
+#include "predicted_scan_cache.h"
 
 #ifndef SRC_PARTICLE_FILTER_H_
 #define SRC_PARTICLE_FILTER_H_
 
 namespace particle_filter {
 
-struct Particle {
-  Eigen::Vector2f loc;
-  float angle;
-  double weight;
-};
-
-
 class ParticleFilter {
  public:
   // Default Constructor.
@@ -59,17 +60,35 @@ class ParticleFilter {
   // Predict particle motion based on odometry.
   void Predict(const Eigen::Vector2f &odom_cur_pos, const float &odom_cur_angle);
 
-  // Initialize the robot location.
+  // Initialize the robot location. The map is loaded on a background thread
+  // unless it is already in the process-wide map cache, so this never blocks
+  // for long; laser scans are ignored until the map is ready. If map_file is
+  // a tiled map, only the tiles around the location estimate are loaded.
   void Initialize(const std::string& map_file,
                   const Eigen::Vector2f& loc,
                   const float angle);
 
+  // Global localization: spread particles uniformly over the free space of
+  // the map, and weight them with a coarse sensor model until they converge.
+  void InitializeGlobal(const std::string& map_file);
+
+  // True while the filter is in global localization mode.
+  bool GlobalLocalizationActive() const { return global_localization_; }
+
+  // True while the map requested by Initialize is still being loaded.
+  bool MapLoadPending() const { return map_pending_; }
+
   // Return the list of particles.
   void GetParticles(std::vector<Particle>* particles) const;
 
   // Get robot's current location.
   void GetLocation(Eigen::Vector2f* loc, float* angle) const;
 
+  // Get up to max_hypotheses modes of the particle distribution, heaviest
+  // first, for when the single mean location is ambiguous.
+  void GetPoseHypotheses(int max_hypotheses,
+                         std::vector<PoseHypothesis>* hypotheses) const;
+
   // Update particle weight based on laser.
   void Update(const std::vector<float>& ranges,
               float range_min,
@@ -92,24 +111,105 @@ class ParticleFilter {
                               std::vector<Eigen::Vector2f>* scan);
 
  double get_angle_diff(double a, double b);
+
+  // Predicted scan cache, for its hit rate and memory counters.
+  const PredictedScanCache& GetPredictedScanCache() const {
+    return scan_cache_;
+  }
   
  private:
+  // Map loaded by a background thread, waiting to be installed.
+  struct MapMailbox;
+
+  // Switch to a new map, which invalidates the cached scans.
+  void SetMap(const std::shared_ptr<const vector_map::VectorMap>& map);
+
+  // Install the map loaded in the background for the latest Initialize call,
+  // or the latest view of the tiled map, if it is ready.
+  void InstallPendingMap();
+
+  // Ray cast num_rays rays from the laser pose, and write the distance to the
+  // first wall each one hits, or the max range, to predicted_ranges.
+  void CastRays(const Eigen::Vector2f& laser_loc,
+                const float angle,
+                int num_rays,
+                float range_min,
+                float range_max,
+                float angle_min,
+                float angle_max,
+                float* predicted_ranges);
+
+  // Predicted ranges of num_rays rays from the laser pose, from the predicted
+  // scan cache if it is enabled. The result is valid until the next call.
+  const float* GetPredictedRanges(const Eigen::Vector2f& laser_loc,
+                                  const float angle,
+                                  int num_rays,
+                                  float range_min,
+                                  float range_max,
+                                  float angle_min,
+                                  float angle_max);
+
+  // Weight all particles with the coarse likelihood field sensor model.
+  void UpdateGlobal(const std::vector<float>& ranges,
+                    float range_min,
+                    float range_max,
+                    float angle_min,
+                    float angle_max);
+
+  // Resample in global localization mode, and switch to tracking once the
+  // particles have converged.
+  void ResampleGlobal();
+
+  // Particles being tracked.
+  ParticleSet particles_;
+
+  // Map of the environment, shared with the process-wide map cache. NULL
+  // until the first map is ready.
+  std::shared_ptr<const vector_map::VectorMap> map_;
 
-  // List of particles being tracked.
-  std::vector<Particle> particles_;
+  // Where background loads publish their maps. It is shared with the loader
+  // threads, which may outlive the filter.
+  std::shared_ptr<MapMailbox> map_mailbox_;
+  // Number of the latest map request; maps loaded for older requests are
+  // dropped.
+  int map_generation_;
+  // True while the map for the latest request is still being loaded.
+  bool map_pending_;
 
-  // Map of the environment.
-  vector_map::VectorMap map_;
+  // Tiled map that map_ is a view of, if the map is tiled.
+  std::unique_ptr<vector_map::TiledVectorMap> tiled_map_;
+
+  // Distance to the nearest wall, for the global localization sensor model.
+  LikelihoodField likelihood_field_;
 
   // Random number generator.
   util_random::Random rng_;
 
+  // Scratch space reused between calls, so that the update step does not
+  // allocate.
+  std::vector<float> predicted_ranges_;
+  std::vector<Eigen::Vector2f> global_beam_endpoints_;
+
+  // Beam sensor model, as a table of the weight of a single beam.
+  BeamModelTable beam_model_table_;
+
+  // Predicted scans, keyed by quantized laser pose, and the scan parameters
+  // they were computed for.
+  PredictedScanCache scan_cache_;
+  float scan_cache_range_min_;
+  float scan_cache_range_max_;
+  float scan_cache_angle_min_;
+  float scan_cache_angle_max_;
+
   // Previous odometry-reported locations.
   Eigen::Vector2f odom_old_pos;
   float odom_old_angle;
   bool odom_initialized_;
   bool predict_step_done_;
 
+  // True while the filter is in global localization mode.
+  bool global_localization_;
+
 
 };
 }  // namespace slam
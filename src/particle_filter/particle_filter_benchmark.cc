@@ -0,0 +1,227 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           particle_filter_benchmark.cc
+\brief          End-to-end benchmark of the particle filter on a simulated
+                robot, without ROS
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "gflags/gflags.h"
+#include "shared/math/math_util.h"
+#include "shared/util/heap_counter.h"
+#include "shared/util/timer.h"
+#include "vector_map/map_cache.h"
+#include "vector_map/vector_map.h"
+
+#include "particle_filter.h"
+
+using Eigen::Vector2f;
+using math_util::AngleDiff;
+using std::max;
+using std::vector;
+
+DEFINE_string(map, "maps/GDC3.txt", "Name of vector map file");
+DEFINE_string(sim_map,
+              "",
+              "Map to simulate the robot in, if not --map, e.g. the text map "
+              "that a tiled --map was made from");
+DEFINE_double(x, -13.93, "Initial x location of the simulated robot");
+DEFINE_double(y, 16.02, "Initial y location of the simulated robot");
+DEFINE_double(theta, 0.0, "Initial angle of the simulated robot");
+DEFINE_int32(steps, 400, "Number of simulated odometry + laser steps");
+DEFINE_bool(global, true, "Start with global localization");
+DEFINE_int32(warmup_steps,
+             50,
+             "Number of tracking steps before heap allocations are counted");
+
+// Simulated laser scanner, matching the real robot.
+const int kNumRanges = 1081;
+const float kRangeMin = 0.02;
+const float kRangeMax = 10.0;
+const float kAngleMin = -2.356;
+const float kAngleMax = 2.356;
+
+// Number of pose hypotheses to ask for.
+const int kMaxHypotheses = 3;
+
+// Drive the robot forward, turning away from walls.
+void SimulateMotion(const vector_map::VectorMap& map,
+                    int step,
+                    Vector2f* loc,
+                    float* angle) {
+  const float kSpeed = 0.05;
+  const Vector2f heading(cos(*angle), sin(*angle));
+  if (map.Intersects(*loc, *loc + 0.6 * heading)) {
+    *angle = math_util::AngleMod(*angle + 0.3f);
+    return;
+  }
+  *loc += kSpeed * heading;
+  *angle = math_util::AngleMod(*angle + 0.01f * sin(0.05f * step));
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, false);
+
+  // Load the map into the process-wide cache, which the filter then shares.
+  const std::string sim_map = FLAGS_sim_map.empty() ? FLAGS_map : FLAGS_sim_map;
+  double t_start = GetMonotonicTime();
+  const std::shared_ptr<const vector_map::VectorMap> map_ptr =
+      vector_map::MapCache::Instance().Load(sim_map);
+  const double t_map_load = GetMonotonicTime() - t_start;
+  t_start = GetMonotonicTime();
+  vector_map::MapCache::Instance().Load(sim_map);
+  const double t_map_cached = GetMonotonicTime() - t_start;
+  const vector_map::VectorMap& map = *map_ptr;
+
+  particle_filter::ParticleFilter particle_filter;
+  Vector2f loc(FLAGS_x, FLAGS_y);
+  float angle = FLAGS_theta;
+
+  t_start = GetMonotonicTime();
+  if (FLAGS_global) {
+    particle_filter.InitializeGlobal(FLAGS_map);
+  } else {
+    particle_filter.Initialize(FLAGS_map, loc, angle);
+  }
+  const double t_initialize = GetMonotonicTime() - t_start;
+  particle_filter.Predict(loc, angle);
+
+  vector<float> ranges;
+  vector<particle_filter::Particle> particles;
+  double t_laser = 0;
+  double t_laser_max = 0;
+  double t_odometry = 0;
+  double t_location = 0;
+  double t_cluster = 0;
+  double t_cluster_max = 0;
+  vector<particle_filter::PoseHypothesis> hypotheses;
+  size_t max_hypotheses = 0;
+  double sum_error = 0;
+  int num_tracking_steps = 0;
+  int converged_step = -1;
+  int steady_state_steps = 0;
+  uint64_t steady_state_allocations = 0;
+  size_t max_particles = 0;
+  for (int step = 0; step < FLAGS_steps; ++step) {
+    SimulateMotion(map, step, &loc, &angle);
+
+    // Once tracking has settled, every call into the filter should run out of
+    // preallocated buffers.
+    const bool steady_state = !particle_filter.GlobalLocalizationActive() &&
+        num_tracking_steps >= FLAGS_warmup_steps;
+    uint64_t allocations = heap_counter::NumAllocations();
+
+    // Odometry, followed by a pose query, as in the odometry callback.
+    t_start = GetMonotonicTime();
+    particle_filter.Predict(loc, angle);
+    t_odometry += GetMonotonicTime() - t_start;
+    Vector2f estimate_loc(0, 0);
+    float estimate_angle(0);
+    t_start = GetMonotonicTime();
+    particle_filter.GetLocation(&estimate_loc, &estimate_angle);
+    t_location += GetMonotonicTime() - t_start;
+    allocations = heap_counter::NumAllocations() - allocations;
+
+    // Laser scan, simulated from the map.
+    const Vector2f laser_loc = loc + 0.2 * Vector2f(cos(angle), sin(angle));
+    map.GetPredictedScan(laser_loc, kRangeMin, kRangeMax,
+                         angle + kAngleMin, angle + kAngleMax,
+                         kNumRanges, &ranges);
+    particle_filter.GetParticles(&particles);
+    max_particles = max(max_particles, particles.size());
+    const uint64_t laser_allocations_start = heap_counter::NumAllocations();
+    t_start = GetMonotonicTime();
+    particle_filter.ObserveLaser(ranges, kRangeMin, kRangeMax,
+                                 kAngleMin, kAngleMax);
+    const double t = GetMonotonicTime() - t_start;
+    allocations += heap_counter::NumAllocations() - laser_allocations_start;
+    t_laser += t;
+    t_laser_max = max(t_laser_max, t);
+    if (steady_state) {
+      steady_state_allocations += allocations;
+      ++steady_state_steps;
+    }
+
+    // Pose hypotheses, as drawn by the visualization.
+    t_start = GetMonotonicTime();
+    particle_filter.GetPoseHypotheses(kMaxHypotheses, &hypotheses);
+    const double t_hypotheses = GetMonotonicTime() - t_start;
+    t_cluster += t_hypotheses;
+    t_cluster_max = max(t_cluster_max, t_hypotheses);
+    max_hypotheses = max(max_hypotheses, hypotheses.size());
+
+    if (converged_step < 0 && !particle_filter.GlobalLocalizationActive()) {
+      converged_step = step;
+    }
+    if (!particle_filter.GlobalLocalizationActive()) {
+      particle_filter.GetLocation(&estimate_loc, &estimate_angle);
+      sum_error += (estimate_loc - loc).norm();
+      ++num_tracking_steps;
+    }
+  }
+
+  Vector2f estimate_loc(0, 0);
+  float estimate_angle(0);
+  particle_filter.GetLocation(&estimate_loc, &estimate_angle);
+  particle_filter.GetParticles(&particles);
+  printf("Map: %s, %d steps\n", FLAGS_map.c_str(), FLAGS_steps);
+  printf("Map load: %.3f ms, from the cache %.3f ms\n",
+         1e3 * t_map_load, 1e3 * t_map_cached);
+  printf("Initialize: %.3f ms\n", 1e3 * t_initialize);
+  printf("ObserveLaser: mean %.3f ms, max %.3f ms\n",
+         1e3 * t_laser / FLAGS_steps, 1e3 * t_laser_max);
+  printf("Predict: mean %.3f ms\n", 1e3 * t_odometry / FLAGS_steps);
+  printf("GetLocation: mean %.3f us\n", 1e6 * t_location / FLAGS_steps);
+  printf("GetPoseHypotheses: mean %.3f ms, max %.3f ms, up to %zu modes\n",
+         1e3 * t_cluster / FLAGS_steps, 1e3 * t_cluster_max, max_hypotheses);
+  printf("Particles: max %zu, final %zu\n", max_particles, particles.size());
+  if (FLAGS_global) {
+    printf("Converged at step: %d\n", converged_step);
+  }
+  const particle_filter::PredictedScanCache& scan_cache =
+      particle_filter.GetPredictedScanCache();
+  printf("Predicted scan cache: hit rate %.3f (%lu hits, %lu misses), "
+         "%d entries, %.1f KiB\n",
+         scan_cache.HitRate(),
+         static_cast<unsigned long>(scan_cache.hits()),
+         static_cast<unsigned long>(scan_cache.misses()),
+         scan_cache.Size(),
+         scan_cache.MemoryBytes() / 1024.0);
+  printf("Steady state heap allocations: %lu in %d steps\n",
+         static_cast<unsigned long>(steady_state_allocations),
+         steady_state_steps);
+  if (num_tracking_steps > 0) {
+    printf("Mean tracking error: %.3f m\n", sum_error / num_tracking_steps);
+  }
+  printf("Final error: %.3f m, %.3f rad\n",
+         (estimate_loc - loc).norm(),
+         fabs(AngleDiff(estimate_angle, angle)));
+  return 0;
+}
@@ -29,7 +29,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sys/stat.h>
 #include <termios.h>
+#include <unistd.h>
+#include <algorithm>
 #include <vector>
 
 #include "eigen3/Eigen/Dense"
@@ -49,8 +52,10 @@
 #include "shared/math/math_util.h"
 #include "shared/math/line2d.h"
 #include "shared/util/timer.h"
+#include "shared/util/trace.h"
 
 #include "particle_filter.h"
+#include "vector_map/tiled_map.h"
 #include "visualization/visualization.h"
 
 using amrl_msgs::VisualizationMsg;
@@ -64,6 +69,7 @@ using std::vector;
 using Eigen::Vector2f;
 using visualization::ClearVisualizationMsg;
 using visualization::DrawArc;
+using visualization::DrawCross;
 using visualization::DrawPoint;
 using visualization::DrawLine;
 using visualization::DrawParticle;
@@ -74,6 +80,13 @@ DEFINE_string(odom_topic, "/odom", "Name of ROS topic for odometry data");
 DEFINE_string(init_topic,
               "/set_pose",
               "Name of ROS topic for initialization");
+DEFINE_bool(global_localization,
+            false,
+            "Start with global localization over the whole map");
+DEFINE_string(trace_file,
+              "",
+              "If set, record a trace of the callbacks to this file, to "
+              "convert with trace_converter");
 
 DECLARE_int32(v);
 
@@ -131,6 +144,24 @@ void PublishPredictedScan() {
   }
 }
 
+void PublishPoseHypotheses() {
+  const uint32_t kColor = 0x00a0d6;
+  const int kMaxHypotheses = 3;
+  vector<particle_filter::PoseHypothesis> hypotheses;
+  particle_filter_.GetPoseHypotheses(kMaxHypotheses, &hypotheses);
+  if (hypotheses.size() < 2) return;
+  // Only draw the modes when there is more than one: a cross the size of the
+  // positional standard deviation, and a line along the mean angle.
+  for (const particle_filter::PoseHypothesis& h : hypotheses) {
+    const float size = sqrt(0.5 * (h.covariance(0, 0) + h.covariance(1, 1)));
+    DrawCross(h.loc, std::max(0.1f, size), kColor, vis_msg_);
+    DrawLine(h.loc,
+             h.loc + 0.5 * Vector2f(cos(h.angle), sin(h.angle)),
+             kColor,
+             vis_msg_);
+  }
+}
+
 void PublishTrajectory() {
   const uint32_t kColor = 0xadadad;
   Vector2f robot_loc(0, 0);
@@ -166,11 +197,13 @@ void PublishVisualization() {
 
   PublishParticles();
   PublishPredictedScan();
+  PublishPoseHypotheses();
   PublishTrajectory();
   visualization_publisher_.publish(vis_msg_);
 }
 
 void LaserCallback(const sensor_msgs::LaserScan& msg) {
+  TRACE_SCOPE("LaserCallback");
   if (FLAGS_v > 0) {
     printf("Laser t=%f\n", msg.header.stamp.toSec());
   }
@@ -185,6 +218,7 @@ void LaserCallback(const sensor_msgs::LaserScan& msg) {
 }
 
 void OdometryCallback(const nav_msgs::Odometry& msg) {
+  TRACE_SCOPE("OdometryCallback");
   if (FLAGS_v > 0) {
     printf("Odometry t=%f\n", msg.header.stamp.toSec());
   }
@@ -210,9 +244,30 @@ void OdometryCallback(const nav_msgs::Odometry& msg) {
 }
 
 void InitCallback(const amrl_msgs::Localization2DMsg& msg) {
+  TRACE_SCOPE("InitCallback");
   const Vector2f init_loc(msg.pose.x, msg.pose.y);
   const float init_angle = msg.pose.theta;
-  const string map = "maps/" + msg.map + ".txt";
+  // A tiled map directory, whose tiles are loaded around the robot as it
+  // moves, takes precedence. Otherwise prefer the binary map, which loads
+  // without parsing, if it has been made with map_converter since the text
+  // map was last changed.
+  const string tiled_map = "maps/" + msg.map;
+  const string text_map = "maps/" + msg.map + ".txt";
+  string map = "maps/" + msg.map + ".vmap";
+  struct stat text_stat;
+  struct stat binary_stat;
+  if (vector_map::IsTiledMap(tiled_map)) {
+    map = tiled_map;
+  } else if (stat(map.c_str(), &binary_stat) != 0) {
+    map = text_map;
+  } else if (stat(text_map.c_str(), &text_stat) == 0 &&
+             text_stat.st_mtime > binary_stat.st_mtime) {
+    printf("WARNING: %s is older than %s, loading the text map. "
+           "Run map_converter to update it.\n",
+           map.c_str(),
+           text_map.c_str());
+    map = text_map;
+  }
   printf("Initialize: %s (%f,%f) %f\u00b0\n",
          map.c_str(),
          init_loc.x(),
@@ -237,7 +292,10 @@ void ProcessLive(ros::NodeHandle* n) {
       OdometryCallback);
   while (ros::ok() && run_) {
     ros::spinOnce();
-    PublishVisualization();
+    {
+      TRACE_SCOPE("PublishVisualization");
+      PublishVisualization();
+    }
     Sleep(0.01);
   }
 }
@@ -268,7 +326,16 @@ int main(int argc, char** argv) {
   laser_publisher_ =
       n.advertise<sensor_msgs::LaserScan>("scan", 1);
 
+  if (FLAGS_global_localization) {
+    particle_filter_.InitializeGlobal(CONFIG_map_name_);
+  }
+
+  if (!FLAGS_trace_file.empty()) {
+    trace::SetThreadName("main");
+    trace::Start(FLAGS_trace_file);
+  }
   ProcessLive(&n);
+  trace::Stop();
 
   return 0;
 }
@@ -0,0 +1,396 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           particle_set.cc
+\brief          Structure-of-arrays storage for the particle cloud
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/math_util.h"
+#include "shared/util/random.h"
+#include "particle_set.h"
+
+using Eigen::Vector2f;
+using std::max;
+using std::vector;
+
+namespace {
+
+// Marks an empty slot in the KLD bin hash set. The bin keys never have the
+// top bit set.
+const uint64_t kEmptyBin = ~static_cast<uint64_t>(0);
+
+// Pack the (x, y, angle) histogram bin indices into a single key.
+uint64_t KldBinKey(float x, float y, float angle,
+                   const particle_filter::KldParams& params) {
+  const uint64_t kMask = (static_cast<uint64_t>(1) << 21) - 1;
+  const int64_t ix = static_cast<int64_t>(floor(x / params.bin_size_xy));
+  const int64_t iy = static_cast<int64_t>(floor(y / params.bin_size_xy));
+  const int64_t ia = static_cast<int64_t>(
+      floor(math_util::AngleMod(angle) / params.bin_size_angle));
+  return ((static_cast<uint64_t>(ix) & kMask) << 42) |
+      ((static_cast<uint64_t>(iy) & kMask) << 21) |
+      (static_cast<uint64_t>(ia) & kMask);
+}
+
+// Insert key into the hash set, and return true iff it was not already there.
+bool InsertKldBin(uint64_t key, vector<uint64_t>* bins_ptr) {
+  vector<uint64_t>& bins = *bins_ptr;
+  const uint64_t mask = bins.size() - 1;
+  uint64_t slot = key * 0x9E3779B97F4A7C15ull;
+  slot = (slot ^ (slot >> 32)) & mask;
+  while (bins[slot] != kEmptyBin) {
+    if (bins[slot] == key) return false;
+    slot = (slot + 1) & mask;
+  }
+  bins[slot] = key;
+  return true;
+}
+
+// Number of samples needed so that, with probability 1 - delta, the KL
+// divergence between the sample-based estimate and the true posterior is
+// below epsilon, if the posterior occupies k bins (Wilson-Hilferty
+// approximation of the chi-square quantile).
+double KldBound(int k, const particle_filter::KldParams& params) {
+  if (k < 2) return 0;
+  const double a = 2.0 / (9.0 * (k - 1));
+  const double b = 1.0 - a + sqrt(a) * params.z;
+  return (k - 1) / (2.0 * params.epsilon) * b * b * b;
+}
+
+}  // namespace
+
+namespace particle_filter {
+
+ParticleSet::ParticleSet() :
+    max_log_weight_(-std::numeric_limits<double>::infinity()),
+    weights_valid_(false),
+    total_weight_(0),
+    location_valid_(false),
+    sum_x_(0),
+    sum_y_(0),
+    sum_cos_(0),
+    sum_sin_(0) {}
+
+void ParticleSet::Clear() {
+  x.clear();
+  y.clear();
+  angle.clear();
+  log_weight.clear();
+  ResetMaxLogWeight();
+}
+
+void ParticleSet::Resize(size_t n) {
+  x.resize(n);
+  y.resize(n);
+  angle.resize(n);
+  log_weight.resize(n);
+  InvalidateWeights();
+}
+
+void ParticleSet::Reserve(size_t n) {
+  x.reserve(n);
+  y.reserve(n);
+  angle.reserve(n);
+  log_weight.reserve(n);
+  back_x_.reserve(n);
+  back_y_.reserve(n);
+  back_angle_.reserve(n);
+  back_log_weight_.reserve(n);
+  noise_x_.reserve(n);
+  noise_y_.reserve(n);
+  noise_angle_.reserve(n);
+  weights_.reserve(n);
+  cumulative_weights_.reserve(n);
+}
+
+void ParticleSet::PushBack(const Particle& p) {
+  x.push_back(p.loc.x());
+  y.push_back(p.loc.y());
+  angle.push_back(p.angle);
+  log_weight.push_back(p.weight);
+  max_log_weight_ = max(max_log_weight_, p.weight);
+  InvalidateWeights();
+}
+
+Particle ParticleSet::Get(size_t i) const {
+  Particle p;
+  p.loc = Vector2f(x[i], y[i]);
+  p.angle = angle[i];
+  p.weight = log_weight[i];
+  return p;
+}
+
+void ParticleSet::Set(size_t i, const Particle& p) {
+  x[i] = p.loc.x();
+  y[i] = p.loc.y();
+  angle[i] = p.angle;
+  SetLogWeight(i, p.weight);
+}
+
+void ParticleSet::GetParticles(vector<Particle>* particles) const {
+  particles->resize(Size());
+  for (size_t i = 0; i < Size(); ++i) {
+    (*particles)[i] = Get(i);
+  }
+}
+
+void ParticleSet::Predict(const Vector2f& delta_loc,
+                          float delta_angle,
+                          float trans_stddev,
+                          float angle_stddev,
+                          util_random::Random* rng) {
+  const size_t n = Size();
+  noise_x_.resize(n);
+  noise_y_.resize(n);
+  noise_angle_.resize(n);
+
+  // Draw all of the noise up front, in batches, so that the update loop below
+  // is free of calls into the random number generator.
+  rng->Gaussians(0, trans_stddev, n, noise_x_.data());
+  rng->Gaussians(0, trans_stddev, n, noise_y_.data());
+  rng->Gaussians(0, angle_stddev, n, noise_angle_.data());
+
+  // The weights do not change, so the location accumulators of the moved set
+  // can be summed up in the same pass.
+  NormalizeWeights();
+  const double* const w = weights_.data();
+  double sum_x = 0;
+  double sum_y = 0;
+  double sum_cos = 0;
+  double sum_sin = 0;
+
+  const float dx = delta_loc.x();
+  const float dy = delta_loc.y();
+  float* const px = x.data();
+  float* const py = y.data();
+  float* const pa = angle.data();
+  const float* const nx = noise_x_.data();
+  const float* const ny = noise_y_.data();
+  const float* const na = noise_angle_.data();
+  for (size_t i = 0; i < n; ++i) {
+    // Rotate the odometry translation from the robot frame to the map frame.
+    const float c = cos(pa[i]);
+    const float s = sin(pa[i]);
+    px[i] += c * dx - s * dy + nx[i];
+    py[i] += s * dx + c * dy + ny[i];
+    pa[i] += delta_angle + na[i];
+    sum_x += px[i] * w[i];
+    sum_y += py[i] * w[i];
+    sum_cos += cos(pa[i]) * w[i];
+    sum_sin += sin(pa[i]) * w[i];
+  }
+  sum_x_ = sum_x;
+  sum_y_ = sum_y;
+  sum_cos_ = sum_cos;
+  sum_sin_ = sum_sin;
+  location_valid_ = true;
+}
+
+void ParticleSet::ResetMaxLogWeight() {
+  max_log_weight_ = -std::numeric_limits<double>::infinity();
+  InvalidateWeights();
+}
+
+void ParticleSet::RecomputeMaxLogWeight() {
+  ResetMaxLogWeight();
+  for (size_t i = 0; i < Size(); ++i) {
+    max_log_weight_ = max(max_log_weight_, log_weight[i]);
+  }
+}
+
+void ParticleSet::ResetLogWeights() {
+  std::fill(log_weight.begin(), log_weight.end(), 0.0);
+  max_log_weight_ = 0;
+  InvalidateWeights();
+}
+
+void ParticleSet::NormalizeWeights() const {
+  if (weights_valid_) return;
+  const size_t n = Size();
+  weights_.resize(n);
+  const double max_log_weight = max_log_weight_;
+  const double* const lw = log_weight.data();
+  double* const w = weights_.data();
+  for (size_t i = 0; i < n; ++i) {
+    w[i] = exp(lw[i] - max_log_weight);
+  }
+  double total_weight = 0;
+  for (size_t i = 0; i < n; ++i) {
+    total_weight += w[i];
+  }
+  total_weight_ = total_weight;
+  weights_valid_ = true;
+}
+
+const AlignedVector<double>& ParticleSet::NormalizedWeights() const {
+  NormalizeWeights();
+  return weights_;
+}
+
+double ParticleSet::TotalWeight() const {
+  NormalizeWeights();
+  return total_weight_;
+}
+
+void ParticleSet::UpdateLocationSums() const {
+  if (location_valid_) return;
+  NormalizeWeights();
+  double sum_x = 0;
+  double sum_y = 0;
+  double sum_cos = 0;
+  double sum_sin = 0;
+  for (size_t i = 0; i < Size(); ++i) {
+    sum_x += x[i] * weights_[i];
+    sum_y += y[i] * weights_[i];
+    sum_cos += cos(angle[i]) * weights_[i];
+    sum_sin += sin(angle[i]) * weights_[i];
+  }
+  sum_x_ = sum_x;
+  sum_y_ = sum_y;
+  sum_cos_ = sum_cos;
+  sum_sin_ = sum_sin;
+  location_valid_ = true;
+}
+
+void ParticleSet::GetLocation(Vector2f* loc, float* angle_ptr) const {
+  if (Empty()) return;
+  UpdateLocationSums();
+  loc->x() = sum_x_ / total_weight_;
+  loc->y() = sum_y_ / total_weight_;
+  *angle_ptr = atan2(sum_sin_ / total_weight_, sum_cos_ / total_weight_);
+}
+
+float ParticleSet::GetLocationSpread() const {
+  const size_t n = Size();
+  if (n == 0) return 0;
+  NormalizeWeights();
+
+  double sum_x = 0;
+  double sum_y = 0;
+  double sum_sq = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum_x += x[i] * weights_[i];
+    sum_y += y[i] * weights_[i];
+    sum_sq += (x[i] * x[i] + y[i] * y[i]) * weights_[i];
+  }
+  const double mean_x = sum_x / total_weight_;
+  const double mean_y = sum_y / total_weight_;
+  return sqrt(max(0.0, sum_sq / total_weight_ - mean_x * mean_x -
+                  mean_y * mean_y));
+}
+
+bool ParticleSet::Resample(util_random::Random* rng) {
+  const size_t n = Size();
+  if (n == 0) return false;
+
+  // Cumulative weights form the bins of the low variance sampler.
+  const AlignedVector<double>& weights = NormalizedWeights();
+  AlignedVector<double>& bin_edges = cumulative_weights_;
+  bin_edges.resize(n);
+  std::partial_sum(weights.begin(), weights.end(), bin_edges.begin());
+  const double total_weight = bin_edges[n - 1];
+  const double step = total_weight / n;
+  if (step == 0) return false;
+
+  ClearBack();
+  double r = rng->UniformRandom(0, step);
+  for (size_t m = 0; m < n; ++m) {
+    while (bin_edges[m] > r) {
+      CopyToBack(m);
+      r += step;
+    }
+  }
+  SwapBuffers();
+  ResetLogWeights();
+  return true;
+}
+
+bool ParticleSet::ResampleKld(const KldParams& params,
+                              util_random::Random* rng) {
+  const size_t n = Size();
+  if (n == 0) return false;
+
+  const AlignedVector<double>& weights = NormalizedWeights();
+  AlignedVector<double>& cumulative_weights = cumulative_weights_;
+  cumulative_weights.resize(n);
+  std::partial_sum(weights.begin(), weights.end(), cumulative_weights.begin());
+  const double total_weight = cumulative_weights[n - 1];
+  if (total_weight == 0) return false;
+
+  // Keep the hash set at most half full.
+  const size_t max_particles = max(1, params.max_particles);
+  size_t num_bins = 1;
+  while (num_bins < 2 * max_particles) num_bins *= 2;
+  kld_bins_.resize(num_bins);
+  std::fill(kld_bins_.begin(), kld_bins_.end(), kEmptyBin);
+
+  ClearBack();
+  size_t num_samples = 0;
+  size_t target = max(1, params.min_particles);
+  int occupied_bins = 0;
+  while (num_samples < target && num_samples < max_particles) {
+    const double r = rng->UniformRandom(0, total_weight);
+    const size_t m = std::min<size_t>(
+        n - 1,
+        std::upper_bound(cumulative_weights.begin(),
+                         cumulative_weights.end(),
+                         r) - cumulative_weights.begin());
+    CopyToBack(m);
+    ++num_samples;
+    if (InsertKldBin(KldBinKey(x[m], y[m], angle[m], params), &kld_bins_)) {
+      ++occupied_bins;
+      target = max<size_t>(target, ceil(KldBound(occupied_bins, params)));
+    }
+  }
+  SwapBuffers();
+  ResetLogWeights();
+  return true;
+}
+
+void ParticleSet::ClearBack() {
+  back_x_.clear();
+  back_y_.clear();
+  back_angle_.clear();
+  back_log_weight_.clear();
+}
+
+void ParticleSet::CopyToBack(size_t i) {
+  back_x_.push_back(x[i]);
+  back_y_.push_back(y[i]);
+  back_angle_.push_back(angle[i]);
+  back_log_weight_.push_back(log_weight[i]);
+}
+
+void ParticleSet::SwapBuffers() {
+  x.swap(back_x_);
+  y.swap(back_y_);
+  angle.swap(back_angle_);
+  log_weight.swap(back_log_weight_);
+}
+
+}  // namespace particle_filter
@@ -0,0 +1,210 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           particle_set.h
+\brief          Structure-of-arrays storage for the particle cloud
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "eigen3/Eigen/StdVector"
+#include "shared/util/random.h"
+
+#ifndef SRC_PARTICLE_SET_H_
+#define SRC_PARTICLE_SET_H_
+
+namespace particle_filter {
+
+struct Particle {
+  Eigen::Vector2f loc;
+  float angle;
+  double weight;
+};
+
+// Parameters of KLD-sampling (Fox, 2003), which picks the number of particles
+// from the number of histogram bins that the resampled particles occupy.
+struct KldParams {
+  // Bounds on the number of particles drawn.
+  int min_particles;
+  int max_particles;
+  // Maximum allowed KL divergence between the sample-based approximation and
+  // the true posterior.
+  float epsilon;
+  // Upper 1 - delta quantile of the standard normal distribution.
+  float z;
+  // Histogram bin sizes.
+  float bin_size_xy;
+  float bin_size_angle;
+};
+
+// 16-byte aligned array, so that the per-particle loops below can be
+// auto-vectorised by the compiler.
+template <typename T>
+using AlignedVector = std::vector<T, Eigen::aligned_allocator<T>>;
+
+// The particle cloud, stored as one array per field instead of one struct per
+// particle. Every stage of the filter walks a single field at a time, so this
+// keeps the memory accesses contiguous.
+class ParticleSet {
+ public:
+  ParticleSet();
+
+  // Number of particles in the set.
+  size_t Size() const { return x.size(); }
+
+  bool Empty() const { return x.empty(); }
+
+  void Clear();
+
+  void Resize(size_t n);
+
+  // Preallocate every buffer of the set for up to n particles, so that
+  // predicting and resampling a set of at most n particles never allocates.
+  void Reserve(size_t n);
+
+  void PushBack(const Particle& p);
+
+  // Read / write a single particle, for callers that want the old struct.
+  Particle Get(size_t i) const;
+  void Set(size_t i, const Particle& p);
+
+  // Adapter for visualisation: copy the set into the array-of-structs form.
+  void GetParticles(std::vector<Particle>* particles) const;
+
+  // Motion model: move every particle by delta_loc (in the robot frame) and
+  // delta_angle, adding zero mean Gaussian noise with the given standard
+  // deviations to the map-frame translation and to the angle.
+  void Predict(const Eigen::Vector2f& delta_loc,
+               float delta_angle,
+               float trans_stddev,
+               float angle_stddev,
+               util_random::Random* rng);
+
+  // Log weights. The set tracks their max and caches the normalized weights,
+  // exp(log_weight - max), computed at most once per update. Write them with
+  // SetLogWeight(); after writing the log_weight array directly, call
+  // RecomputeMaxLogWeight().
+
+  // Forget the max log weight, before setting every log weight anew.
+  void ResetMaxLogWeight();
+
+  // Set the log weight of particle i, and update the max.
+  void SetLogWeight(size_t i, double w) {
+    log_weight[i] = w;
+    if (w > max_log_weight_) max_log_weight_ = w;
+    InvalidateWeights();
+  }
+
+  // Recompute the max log weight from scratch.
+  void RecomputeMaxLogWeight();
+
+  double max_log_weight() const { return max_log_weight_; }
+
+  // Normalized weights of the particles, and their sum.
+  const AlignedVector<double>& NormalizedWeights() const;
+  double TotalWeight() const;
+
+  // Weighted mean location and circular mean angle of the set. The weighted
+  // sums behind it are kept up to date by Predict, and only recomputed after
+  // the weights change, so between updates this is O(1).
+  void GetLocation(Eigen::Vector2f* loc, float* angle) const;
+
+  // Weighted root mean square distance of the particles from their weighted
+  // mean location.
+  float GetLocationSpread() const;
+
+  // Resampling writes the new particles into a back buffer, which is then
+  // swapped with the front arrays below. The resampled particles all get a log
+  // weight of 0.
+
+  // Low variance resampling, proportional to the particle weights. Returns
+  // false, leaving the set untouched, if the weights are all zero.
+  bool Resample(util_random::Random* rng);
+
+  // KLD-sampling: draw particles proportional to their weights until the
+  // number drawn reaches the KLD bound for the number of occupied histogram
+  // bins, within [min_particles, max_particles]. Returns false, leaving the
+  // set untouched, if the weights are all zero.
+  bool ResampleKld(const KldParams& params, util_random::Random* rng);
+
+  AlignedVector<float> x;
+  AlignedVector<float> y;
+  AlignedVector<float> angle;
+  AlignedVector<double> log_weight;
+
+ private:
+  // Mark the normalized weights and the location sums out of date.
+  void InvalidateWeights() {
+    weights_valid_ = false;
+    location_valid_ = false;
+  }
+
+  // Fill the normalized weight cache, if it is out of date.
+  void NormalizeWeights() const;
+
+  // Recompute the location sums, if they are out of date.
+  void UpdateLocationSums() const;
+
+  // Give every particle a log weight of 0, after resampling.
+  void ResetLogWeights();
+
+  // Empty the back buffer, copy particle i of the front arrays to the end of
+  // it, and swap it with the front arrays.
+  void ClearBack();
+  void CopyToBack(size_t i);
+  void SwapBuffers();
+
+  // Back buffer for resampling.
+  AlignedVector<float> back_x_;
+  AlignedVector<float> back_y_;
+  AlignedVector<float> back_angle_;
+  AlignedVector<double> back_log_weight_;
+
+  // Max log weight, and the cached normalized weights and their sum.
+  double max_log_weight_;
+  mutable bool weights_valid_;
+  mutable AlignedVector<double> weights_;
+  mutable double total_weight_;
+
+  // Weighted sums of the locations and of the unit vectors of the angles.
+  mutable bool location_valid_;
+  mutable double sum_x_;
+  mutable double sum_y_;
+  mutable double sum_cos_;
+  mutable double sum_sin_;
+
+  // Scratch space for the cumulative weights during resampling.
+  AlignedVector<double> cumulative_weights_;
+
+  // Scratch space for the motion model noise.
+  AlignedVector<float> noise_x_;
+  AlignedVector<float> noise_y_;
+  AlignedVector<float> noise_angle_;
+
+  // Open addressing hash set of the histogram bins occupied during
+  // KLD-sampling.
+  std::vector<uint64_t> kld_bins_;
+};
+
+}  // namespace particle_filter
+
+#endif   // SRC_PARTICLE_SET_H_
@@ -0,0 +1,185 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           predicted_scan_cache.cc
+\brief          LRU cache of predicted laser scans, keyed by quantized pose
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/math_util.h"
+#include "predicted_scan_cache.h"
+
+using Eigen::Vector2f;
+
+namespace {
+
+inline uint64_t Hash(uint64_t key) {
+  key *= 0x9E3779B97F4A7C15ull;
+  return key ^ (key >> 32);
+}
+
+}  // namespace
+
+namespace particle_filter {
+
+PredictedScanCache::PredictedScanCache() :
+    resolution_xy_(0),
+    resolution_angle_(0),
+    capacity_(0),
+    num_ranges_(0),
+    size_(0),
+    head_(-1),
+    tail_(-1),
+    hits_(0),
+    misses_(0) {}
+
+void PredictedScanCache::Configure(float resolution_xy,
+                                   float resolution_angle,
+                                   int capacity,
+                                   int num_ranges) {
+  if (resolution_xy == resolution_xy_ &&
+      resolution_angle == resolution_angle_ &&
+      capacity == capacity_ &&
+      num_ranges == num_ranges_) {
+    return;
+  }
+  resolution_xy_ = resolution_xy;
+  resolution_angle_ = resolution_angle;
+  capacity_ = std::max(1, capacity);
+  num_ranges_ = num_ranges;
+
+  // Keep the hash table at most half full.
+  int table_size = 1;
+  while (table_size < 2 * capacity_) table_size *= 2;
+  table_.resize(table_size);
+  keys_.resize(capacity_);
+  prev_.resize(capacity_);
+  next_.resize(capacity_);
+  ranges_.resize(static_cast<size_t>(capacity_) * num_ranges_);
+  Clear();
+}
+
+void PredictedScanCache::Clear() {
+  std::fill(table_.begin(), table_.end(), -1);
+  size_ = 0;
+  head_ = -1;
+  tail_ = -1;
+}
+
+uint64_t PredictedScanCache::Quantize(const Vector2f& loc,
+                                      float angle,
+                                      Vector2f* center_loc,
+                                      float* center_angle) const {
+  const uint64_t kMask = (static_cast<uint64_t>(1) << 21) - 1;
+  const int64_t ix = static_cast<int64_t>(floor(loc.x() / resolution_xy_));
+  const int64_t iy = static_cast<int64_t>(floor(loc.y() / resolution_xy_));
+  const int64_t ia = static_cast<int64_t>(
+      floor(math_util::AngleMod(angle) / resolution_angle_));
+  *center_loc = resolution_xy_ * Vector2f(ix + 0.5f, iy + 0.5f);
+  *center_angle = resolution_angle_ * (ia + 0.5f);
+  return ((static_cast<uint64_t>(ix) & kMask) << 42) |
+      ((static_cast<uint64_t>(iy) & kMask) << 21) |
+      (static_cast<uint64_t>(ia) & kMask);
+}
+
+int PredictedScanCache::FindSlot(uint64_t key) const {
+  const int mask = table_.size() - 1;
+  int slot = Hash(key) & mask;
+  while (table_[slot] >= 0 && keys_[table_[slot]] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void PredictedScanCache::EraseSlot(int slot) {
+  // Backward shift deletion: move later entries of the probe sequence into
+  // the hole, so that lookups never need tombstones.
+  const int mask = table_.size() - 1;
+  int hole = slot;
+  int j = slot;
+  while (true) {
+    j = (j + 1) & mask;
+    if (table_[j] < 0) break;
+    const int home = Hash(keys_[table_[j]]) & mask;
+    // The entry at j may move to the hole only if its home slot is not
+    // cyclically within (hole, j].
+    const bool stays = (hole <= j) ?
+        (hole < home && home <= j) : (hole < home || home <= j);
+    if (!stays) {
+      table_[hole] = table_[j];
+      hole = j;
+    }
+  }
+  table_[hole] = -1;
+}
+
+void PredictedScanCache::Unlink(int i) {
+  if (prev_[i] >= 0) next_[prev_[i]] = next_[i]; else head_ = next_[i];
+  if (next_[i] >= 0) prev_[next_[i]] = prev_[i]; else tail_ = prev_[i];
+}
+
+void PredictedScanCache::PushFront(int i) {
+  prev_[i] = -1;
+  next_[i] = head_;
+  if (head_ >= 0) prev_[head_] = i; else tail_ = i;
+  head_ = i;
+}
+
+const float* PredictedScanCache::Find(uint64_t key) {
+  if (table_.empty()) return NULL;
+  const int i = table_[FindSlot(key)];
+  if (i < 0) {
+    ++misses_;
+    return NULL;
+  }
+  ++hits_;
+  if (i != head_) {
+    Unlink(i);
+    PushFront(i);
+  }
+  return &ranges_[static_cast<size_t>(i) * num_ranges_];
+}
+
+float* PredictedScanCache::Insert(uint64_t key) {
+  int i;
+  if (size_ < capacity_) {
+    i = size_++;
+  } else {
+    i = tail_;
+    EraseSlot(FindSlot(keys_[i]));
+    Unlink(i);
+  }
+  keys_[i] = key;
+  table_[FindSlot(key)] = i;
+  PushFront(i);
+  return &ranges_[static_cast<size_t>(i) * num_ranges_];
+}
+
+size_t PredictedScanCache::MemoryBytes() const {
+  return table_.capacity() * sizeof(int) +
+      keys_.capacity() * sizeof(uint64_t) +
+      (prev_.capacity() + next_.capacity()) * sizeof(int) +
+      ranges_.capacity() * sizeof(float);
+}
+
+}  // namespace particle_filter
@@ -0,0 +1,125 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file           predicted_scan_cache.h
+\brief          LRU cache of predicted laser scans, keyed by quantized pose
+\university:    The University of Texas at Austin
+\class:         CS 393r Autonomous Robots
+\assignment:    Assignment 2 - Particle Filter
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+
+#ifndef SRC_PREDICTED_SCAN_CACHE_H_
+#define SRC_PREDICTED_SCAN_CACHE_H_
+
+namespace particle_filter {
+
+// Cache of predicted range vectors, keyed by the laser pose quantized to a
+// grid in (x, y, theta). After resampling many particles sit almost on top
+// of each other, so they can share the ray casting of a single pose. The
+// cache holds a fixed number of entries, evicting the least recently used,
+// and never allocates after Configure().
+class PredictedScanCache {
+ public:
+  PredictedScanCache();
+
+  // Set the quantization, the number of entries and the number of ranges per
+  // entry. This empties the cache, unless the settings are unchanged.
+  void Configure(float resolution_xy,
+                 float resolution_angle,
+                 int capacity,
+                 int num_ranges);
+
+  // Remove every entry, e.g. when the map changes.
+  void Clear();
+
+  // Quantize a laser pose: return its key, and the pose at the center of its
+  // grid cell, which is the pose the cached ranges are computed from.
+  uint64_t Quantize(const Eigen::Vector2f& loc,
+                    float angle,
+                    Eigen::Vector2f* center_loc,
+                    float* center_angle) const;
+
+  // Return the ranges cached under key, or NULL if there are none.
+  const float* Find(uint64_t key);
+
+  // Add an entry for key, evicting the least recently used entry if the cache
+  // is full, and return its ranges for the caller to fill in.
+  float* Insert(uint64_t key);
+
+  // Number of ranges per entry.
+  int num_ranges() const { return num_ranges_; }
+
+  // Number of entries in use.
+  int Size() const { return size_; }
+
+  // Counters, for tuning the quantization.
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  double HitRate() const {
+    return (hits_ + misses_ == 0) ?
+        0.0 : static_cast<double>(hits_) / (hits_ + misses_);
+  }
+  void ResetCounters() { hits_ = misses_ = 0; }
+
+  // Number of bytes held by the cache.
+  size_t MemoryBytes() const;
+
+ private:
+  // Slot of the hash table that holds key, or the empty slot where it would
+  // go.
+  int FindSlot(uint64_t key) const;
+
+  // Remove the key in the given slot from the hash table.
+  void EraseSlot(int slot);
+
+  // Unlink entry i from the LRU list, and link it back in at the front.
+  void Unlink(int i);
+  void PushFront(int i);
+
+  float resolution_xy_;
+  float resolution_angle_;
+  int capacity_;
+  int num_ranges_;
+
+  // Number of entries in use.
+  int size_;
+
+  // Open addressing hash table of entry indices, -1 for an empty slot.
+  std::vector<int> table_;
+
+  // Per entry key, and LRU list links, most recently used at the head.
+  std::vector<uint64_t> keys_;
+  std::vector<int> prev_;
+  std::vector<int> next_;
+  int head_;
+  int tail_;
+
+  // num_ranges_ ranges per entry.
+  std::vector<float> ranges_;
+
+  uint64_t hits_;
+  uint64_t misses_;
+};
+
+}  // namespace particle_filter
+
+#endif   // SRC_PREDICTED_SCAN_CACHE_H_
@@ -0,0 +1,86 @@
+// Exact Euclidean distance transform of sampled grids.
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+#ifndef SRC_MATH_DISTANCE_TRANSFORM_H_
+#define SRC_MATH_DISTANCE_TRANSFORM_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace distance_transform {
+
+// Large stand-in for an infinite squared distance.
+const double kInf = 1e20;
+
+// One dimensional squared Euclidean distance transform of the sampled
+// function f, of length n (Felzenszwalb & Huttenlocher, 2012). v and z are
+// scratch arrays of length n and n + 1.
+inline void SquaredDistanceTransform1D(const double* f,
+                                       int n,
+                                       double* d,
+                                       int* v,
+                                       double* z) {
+  int k = 0;
+  v[0] = 0;
+  z[0] = -kInf;
+  z[1] = kInf;
+  for (int q = 1; q < n; ++q) {
+    double s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    while (s <= z[k]) {
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = kInf;
+  }
+  k = 0;
+  for (int q = 0; q < n; ++q) {
+    while (z[k + 1] < q) ++k;
+    d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+// Squared Euclidean distance transform of a row-major width x height grid,
+// in place, in units of cells. Cells start out as 0 where there is an
+// obstacle and kInf everywhere else, and end up as the squared distance to
+// the nearest obstacle cell.
+inline void SquaredDistanceTransform2D(int width,
+                                       int height,
+                                       std::vector<double>* grid_ptr) {
+  std::vector<double>& grid = *grid_ptr;
+  const int n = std::max(width, height);
+  std::vector<double> f(n);
+  std::vector<double> d(n);
+  std::vector<double> z(n + 1);
+  std::vector<int> v(n);
+  // One pass along the columns, and one along the rows.
+  for (int x = 0; x < width; ++x) {
+    for (int y = 0; y < height; ++y) f[y] = grid[y * width + x];
+    SquaredDistanceTransform1D(f.data(), height, d.data(), v.data(), z.data());
+    for (int y = 0; y < height; ++y) grid[y * width + x] = d[y];
+  }
+  for (int y = 0; y < height; ++y) {
+    double* row = &grid[y * width];
+    std::copy(row, row + width, f.begin());
+    SquaredDistanceTransform1D(f.data(), width, row, v.data(), z.data());
+  }
+}
+
+}  // namespace distance_transform
+
+#endif  // SRC_MATH_DISTANCE_TRANSFORM_H_
@@ -20,8 +20,14 @@
 #ifndef SRC_MATH_STATISTICS_H_
 #define SRC_MATH_STATISTICS_H_
 
+#include <stdint.h>
+
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
+#include "glog/logging.h"
 #include "math/math_util.h"
 
 namespace statistics {
@@ -53,15 +59,283 @@ T ProbabilityDensityUniform(const T& sample, const T& min, const T& max) {
   }
 }
 
+// Get the value at the given percentile, between 0 and 1, of the values in c.
+// This copies the values, and selects the percentile in linear time.
 template <typename Container, typename Type, typename PercentType>
-Type GetPercentile(Container c, const PercentType percentile) {
-  std::sort(c.begin(), c.end());
-  const size_t idx =
-      static_cast<size_t>(static_cast<PercentType>(c.size()) * percentile);
-  const Type& val = c[idx];
-  return val;
+Type GetPercentile(const Container& c, const PercentType percentile) {
+  std::vector<Type> values(c.begin(), c.end());
+  const size_t idx = std::min(
+      values.size() - 1,
+      static_cast<size_t>(static_cast<PercentType>(values.size()) *
+                          percentile));
+  std::nth_element(values.begin(), values.begin() + idx, values.end());
+  return values[idx];
 }
 
+// Streaming estimate of one quantile with the P-Square algorithm of Jain and
+// Chlamtac, in constant memory and time per sample. Five markers track the
+// minimum, the maximum, the quantile and the quantiles halfway to either
+// side, and the heights of the middle three are adjusted with piecewise
+// parabolic interpolation as samples arrive. It is accurate to a small
+// fraction of the spread of the samples around the quantile, but estimates
+// of different streams cannot be merged: use LogHistogram for that.
+template <typename T>
+class P2Quantile {
+ public:
+  // Estimate the given quantile, between 0 and 1.
+  explicit P2Quantile(double quantile) : quantile_(quantile), count_(0) {
+    increments_[0] = 0;
+    increments_[1] = quantile / 2;
+    increments_[2] = quantile;
+    increments_[3] = (1 + quantile) / 2;
+    increments_[4] = 1;
+  }
+
+  void Add(const T& sample) {
+    const double x = static_cast<double>(sample);
+    if (count_ < 5) {
+      heights_[count_] = x;
+      ++count_;
+      if (count_ == 5) {
+        std::sort(heights_, heights_ + 5);
+        for (int i = 0; i < 5; ++i) {
+          positions_[i] = i + 1;
+          desired_[i] = 1 + 4 * increments_[i];
+        }
+      }
+      return;
+    }
+    ++count_;
+    // Find the cell k that x falls into, extending the extreme markers if it
+    // is outside of them, and shift the markers above it.
+    int k = 0;
+    if (x < heights_[0]) {
+      heights_[0] = x;
+      k = 0;
+    } else if (x >= heights_[4]) {
+      heights_[4] = x;
+      k = 3;
+    } else {
+      while (x >= heights_[k + 1]) ++k;
+    }
+    for (int i = k + 1; i < 5; ++i) ++positions_[i];
+    for (int i = 0; i < 5; ++i) desired_[i] += increments_[i];
+    // Move the middle markers that are a position or more away from where
+    // they should be.
+    for (int i = 1; i < 4; ++i) {
+      const double d = desired_[i] - positions_[i];
+      if ((d >= 1 && positions_[i + 1] - positions_[i] > 1) ||
+          (d <= -1 && positions_[i - 1] - positions_[i] < -1)) {
+        const int s = (d > 0) ? 1 : -1;
+        const double h = Parabolic(i, s);
+        if (heights_[i - 1] < h && h < heights_[i + 1]) {
+          heights_[i] = h;
+        } else {
+          heights_[i] = Linear(i, s);
+        }
+        positions_[i] += s;
+      }
+    }
+  }
+
+  // Estimate of the quantile, which is exact until there are 5 samples, and
+  // 0 without any.
+  T Quantile() const {
+    if (count_ == 0) return T(0);
+    if (count_ < 5) {
+      double values[5];
+      std::copy(heights_, heights_ + count_, values);
+      std::sort(values, values + count_);
+      const size_t idx = std::min<size_t>(
+          count_ - 1, static_cast<size_t>(quantile_ * count_));
+      return static_cast<T>(values[idx]);
+    }
+    return static_cast<T>(heights_[2]);
+  }
+
+  uint64_t Count() const { return count_; }
+
+ private:
+  // Height of marker i moved by s positions, by fitting a parabola through
+  // it and its neighbors.
+  double Parabolic(int i, int s) const {
+    const double n_prev = positions_[i - 1];
+    const double n = positions_[i];
+    const double n_next = positions_[i + 1];
+    return heights_[i] + s / (n_next - n_prev) *
+        ((n - n_prev + s) * (heights_[i + 1] - heights_[i]) /
+             (n_next - n) +
+         (n_next - n - s) * (heights_[i] - heights_[i - 1]) /
+             (n - n_prev));
+  }
+
+  // Height of marker i moved by s positions, along the line to its neighbor
+  // in that direction.
+  double Linear(int i, int s) const {
+    return heights_[i] + s * (heights_[i + s] - heights_[i]) /
+        (positions_[i + s] - positions_[i]);
+  }
+
+  const double quantile_;
+  uint64_t count_;
+  // Heights of the markers, or the first samples until there are 5.
+  double heights_[5];
+  // Positions of the markers, counting from 1.
+  int64_t positions_[5];
+  // Desired positions of the markers.
+  double desired_[5];
+  // Increments of the desired positions with each sample.
+  double increments_[5];
+};
+
+// Histogram of non-negative samples, such as latencies or residual
+// magnitudes, in buckets that grow exponentially in size like those of
+// HdrHistogram. Each power of 2 above min_value is split into
+// 2^sub_bucket_bits buckets, so quantiles are within a relative error of
+// 2^-(sub_bucket_bits + 1), and the memory does not grow with the number of
+// samples. Samples below min_value share a single bucket, as do samples of
+// max_value and above. Histograms with the same buckets can be merged, so
+// each thread can fill its own and combine them later.
+template <typename T>
+class LogHistogram {
+ public:
+  // min_value must be positive and below max_value, and sub_bucket_bits
+  // between 0 and 16.
+  LogHistogram(double min_value, double max_value, int sub_bucket_bits) :
+      min_value_(min_value),
+      sub_buckets_(NumSubBuckets(sub_bucket_bits)),
+      num_octaves_(NumOctaves(min_value, max_value)),
+      // Buckets for each octave, and one for the underflow and overflow.
+      counts_(num_octaves_ * sub_buckets_ + 2, 0) {
+    Clear();
+  }
+
+  void Add(const T& sample) {
+    Add(sample, 1);
+  }
+
+  // Add count samples of the same value.
+  void Add(const T& sample, uint64_t count) {
+    const double x = static_cast<double>(sample);
+    counts_[Bucket(x)] += count;
+    count_ += count;
+    sum_ += x * count;
+    min_ = std::min(min_, x);
+    max_ = std::max(max_, x);
+  }
+
+  // Add the samples of other, which must have the same buckets. Returns false,
+  // leaving this unchanged, if it does not.
+  bool Merge(const LogHistogram<T>& other) {
+    if (other.min_value_ != min_value_ ||
+        other.sub_buckets_ != sub_buckets_ ||
+        other.num_octaves_ != num_octaves_) {
+      return false;
+    }
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    return true;
+  }
+
+  void Clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = std::numeric_limits<double>::infinity();
+    max_ = -std::numeric_limits<double>::infinity();
+  }
+
+  // Estimate of the given quantile, between 0 and 1: the middle of the bucket
+  // that holds it, within the range of the samples. Quantiles 0 and 1 are the
+  // exact minimum and maximum. 0 without any samples.
+  T Quantile(double quantile) const {
+    if (count_ == 0) return T(0);
+    if (quantile <= 0) return static_cast<T>(min_);
+    if (quantile >= 1) return static_cast<T>(max_);
+    // Rank of the sample at the quantile, counting from 1.
+    const uint64_t rank = std::max<uint64_t>(1, std::min<uint64_t>(
+        count_, static_cast<uint64_t>(std::ceil(quantile * count_))));
+    uint64_t seen = 0;
+    size_t i = 0;
+    for (; i + 1 < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= rank) break;
+    }
+    double value = 0;
+    if (i == 0) {
+      value = min_;
+    } else if (i + 1 == counts_.size()) {
+      value = max_;
+    } else {
+      value = 0.5 * (BucketStart(i) + BucketStart(i + 1));
+    }
+    return static_cast<T>(std::min(max_, std::max(min_, value)));
+  }
+
+  uint64_t Count() const { return count_; }
+
+  T Mean() const {
+    return (count_ == 0) ? T(0) : static_cast<T>(sum_ / count_);
+  }
+
+  T Min() const { return (count_ == 0) ? T(0) : static_cast<T>(min_); }
+
+  T Max() const { return (count_ == 0) ? T(0) : static_cast<T>(max_); }
+
+ private:
+  static const int kMaxSubBucketBits = 16;
+
+  static int NumSubBuckets(int sub_bucket_bits) {
+    CHECK_GE(sub_bucket_bits, 0);
+    CHECK_LE(sub_bucket_bits, kMaxSubBucketBits);
+    return 1 << sub_bucket_bits;
+  }
+
+  // Number of powers of 2 between min_value and max_value, at least 1.
+  static int NumOctaves(double min_value, double max_value) {
+    CHECK_GT(min_value, 0);
+    CHECK_GT(max_value, min_value);
+    return std::max(1, static_cast<int>(
+        std::ceil(std::log2(max_value / min_value))));
+  }
+
+  // Index of the bucket of x.
+  size_t Bucket(double x) const {
+    if (!(x >= min_value_)) return 0;
+    int exponent = 0;
+    // x / min_value_ = mantissa * 2^exponent, with mantissa in [0.5, 1).
+    const double mantissa = std::frexp(x / min_value_, &exponent);
+    const int octave = exponent - 1;
+    if (octave >= num_octaves_) return counts_.size() - 1;
+    const int sub_bucket = std::min(
+        sub_buckets_ - 1,
+        static_cast<int>((2 * mantissa - 1) * sub_buckets_));
+    return 1 + octave * sub_buckets_ + sub_bucket;
+  }
+
+  // Smallest value in bucket i, for the buckets of the octaves.
+  double BucketStart(size_t i) const {
+    const int octave = (i - 1) / sub_buckets_;
+    const int sub_bucket = (i - 1) % sub_buckets_;
+    return std::ldexp(min_value_, octave) *
+        (1 + static_cast<double>(sub_bucket) / sub_buckets_);
+  }
+
+  const double min_value_;
+  const int sub_buckets_;
+  const int num_octaves_;
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  double sum_;
+  double min_;
+  double max_;
+};
+
 }  // namespace statistics
 
 #endif  // SRC_MATH_STATISTICS_H_
\ No newline at end of file
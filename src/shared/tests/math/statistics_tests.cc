@@ -0,0 +1,118 @@
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "math/statistics.h"
+
+namespace {
+
+// Exponentially distributed samples, with a long tail like latencies.
+std::vector<double> ExponentialSamples(int n, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::exponential_distribution<double> distribution(1.0);
+  std::vector<double> samples(n);
+  for (double& x : samples) x = distribution(rng);
+  return samples;
+}
+
+double ExactQuantile(const std::vector<double>& samples, double quantile) {
+  return statistics::GetPercentile<std::vector<double>, double, double>(
+      samples, quantile);
+}
+
+}  // namespace
+
+TEST(GetPercentile, Values) {
+  const std::vector<int> values = {5, 1, 4, 2, 3};
+  EXPECT_EQ(1, (statistics::GetPercentile<std::vector<int>, int, float>(
+      values, 0.0f)));
+  EXPECT_EQ(3, (statistics::GetPercentile<std::vector<int>, int, float>(
+      values, 0.5f)));
+  EXPECT_EQ(5, (statistics::GetPercentile<std::vector<int>, int, float>(
+      values, 1.0f)));
+}
+
+TEST(P2Quantile, FewSamples) {
+  statistics::P2Quantile<double> median(0.5);
+  EXPECT_EQ(0.0, median.Quantile());
+  median.Add(3);
+  median.Add(1);
+  median.Add(2);
+  EXPECT_EQ(2.0, median.Quantile());
+  EXPECT_EQ(3u, median.Count());
+}
+
+TEST(P2Quantile, Exponential) {
+  const std::vector<double> samples = ExponentialSamples(100000, 1);
+  for (const double quantile : {0.5, 0.95, 0.99}) {
+    statistics::P2Quantile<double> estimator(quantile);
+    for (const double x : samples) estimator.Add(x);
+    const double exact = ExactQuantile(samples, quantile);
+    EXPECT_NEAR(exact, estimator.Quantile(), 0.02 * exact) << quantile;
+  }
+}
+
+TEST(LogHistogram, Exponential) {
+  const std::vector<double> samples = ExponentialSamples(100000, 2);
+  statistics::LogHistogram<double> histogram(1e-6, 1e3, 5);
+  for (const double x : samples) histogram.Add(x);
+  EXPECT_EQ(samples.size(), histogram.Count());
+  for (const double quantile : {0.5, 0.95, 0.99}) {
+    const double exact = ExactQuantile(samples, quantile);
+    EXPECT_NEAR(exact, histogram.Quantile(quantile), exact / 64 + 1e-4)
+        << quantile;
+  }
+  EXPECT_EQ(*std::min_element(samples.begin(), samples.end()),
+            histogram.Quantile(0));
+  EXPECT_EQ(*std::max_element(samples.begin(), samples.end()),
+            histogram.Quantile(1));
+}
+
+TEST(LogHistogram, OutOfRange) {
+  statistics::LogHistogram<double> histogram(1, 100, 3);
+  histogram.Add(0.25);
+  histogram.Add(0.5);
+  histogram.Add(1000);
+  EXPECT_EQ(0.25, histogram.Quantile(0));
+  EXPECT_EQ(0.25, histogram.Quantile(0.5));
+  EXPECT_EQ(1000, histogram.Quantile(1));
+}
+
+TEST(LogHistogram, Merge) {
+  const std::vector<double> samples = ExponentialSamples(10000, 3);
+  statistics::LogHistogram<double> all(1e-3, 1e3, 4);
+  statistics::LogHistogram<double> first(1e-3, 1e3, 4);
+  statistics::LogHistogram<double> second(1e-3, 1e3, 4);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    all.Add(samples[i]);
+    if (i % 2 == 0) {
+      first.Add(samples[i]);
+    } else {
+      second.Add(samples[i]);
+    }
+  }
+  ASSERT_TRUE(first.Merge(second));
+  EXPECT_EQ(all.Count(), first.Count());
+  EXPECT_DOUBLE_EQ(all.Mean(), first.Mean());
+  for (const double quantile : {0.0, 0.5, 0.95, 0.99, 1.0}) {
+    EXPECT_EQ(all.Quantile(quantile), first.Quantile(quantile));
+  }
+  statistics::LogHistogram<double> other(1e-3, 1e3, 5);
+  EXPECT_FALSE(first.Merge(other));
+  EXPECT_EQ(all.Count(), first.Count());
+}
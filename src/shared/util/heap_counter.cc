@@ -0,0 +1,68 @@
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include "util/heap_counter.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace {
+
+std::atomic<uint64_t> num_heap_allocations(0);
+
+void CountAllocation() {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+  CountAllocation();
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  CountAllocation();
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+  CountAllocation();
+  return __libc_realloc(p, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) {
+  CountAllocation();
+  *p = __libc_memalign(alignment, size);
+  return (*p == NULL) ? ENOMEM : 0;
+}
+}  // extern "C"
+
+namespace heap_counter {
+
+uint64_t NumAllocations() {
+  return num_heap_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace heap_counter
@@ -0,0 +1,35 @@
+// Count of heap allocations, for checking that code is allocation free.
+// Linking heap_counter.cc into an executable interposes on the glibc
+// allocator, which both operator new and Eigen's aligned allocator end up
+// calling. It is not part of the shared library, so only the executables
+// that list it count their allocations.
+//
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include <stdint.h>
+
+#ifndef SRC_UTIL_HEAP_COUNTER_H_
+#define SRC_UTIL_HEAP_COUNTER_H_
+
+namespace heap_counter {
+
+// Number of calls to malloc, calloc, realloc and posix_memalign so far, by
+// all threads.
+uint64_t NumAllocations();
+
+}  // namespace heap_counter
+
+#endif  // SRC_UTIL_HEAP_COUNTER_H_
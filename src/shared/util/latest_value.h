@@ -0,0 +1,207 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+//
+// Lock-free cells holding the latest value written by one thread for others
+// to read, in place of ThreadSafe<T> where readers must never block writers.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#ifndef SRC_UTIL_LATEST_VALUE_H_
+#define SRC_UTIL_LATEST_VALUE_H_
+
+namespace latest_value {
+
+// Latest value of a small, trivially copyable type, such as a pose, behind a
+// sequence lock. Any number of threads may Get and Set it. Get never blocks
+// Set: it retries if a Set happened while it was copying the value. Sets are
+// serialized among themselves, with a spin.
+template <typename T>
+class SeqLock {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock values must be trivially copyable");
+
+  SeqLock() : sequence_(0) {
+    const T value = T();
+    Store(value);
+  }
+
+  explicit SeqLock(const T& value) : sequence_(0) {
+    Store(value);
+  }
+
+  // Set the value, seen by every Get that starts after this returns.
+  void Set(const T& value) {
+    // An odd sequence means that a Set is in progress.
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    while ((sequence & 1) != 0 ||
+           !sequence_.compare_exchange_weak(sequence,
+                                            sequence + 1,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+      std::this_thread::yield();
+      sequence = sequence_.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    Store(value);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Get a copy of the latest value.
+  T Get() const {
+    T value;
+    Get(&value);
+    return value;
+  }
+
+  // Copy the latest value to value, and return the number of times that it
+  // has been Set, which readers can compare to skip values already seen.
+  uint64_t Get(T* value) const {
+    uint64_t words[kNumWords];
+    while (true) {
+      const uint64_t sequence = sequence_.load(std::memory_order_acquire);
+      if ((sequence & 1) == 0) {
+        for (int i = 0; i < kNumWords; ++i) {
+          words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == sequence) {
+          memcpy(value, words, sizeof(T));
+          return sequence / 2;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  // Disable copy constructor and assignment operator.
+  SeqLock(const SeqLock&);
+  void operator=(const SeqLock&);
+
+  // The value is copied through atomic words, so that a Get that races with
+  // a Set reads a torn value that it then discards, rather than being a data
+  // race.
+  static const int kNumWords = (sizeof(T) + 7) / 8;
+
+  void Store(const T& value) {
+    uint64_t words[kNumWords] = {0};
+    memcpy(words, &value, sizeof(T));
+    for (int i = 0; i < kNumWords; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t> sequence_;
+  std::atomic<uint64_t> words_[kNumWords];
+};
+
+// Latest value of a large type, such as a scan, exchanged between one writer
+// thread and one reader thread through three buffers: the writer fills the
+// back buffer, the reader reads the front buffer, and the latest complete
+// value waits in the middle. Neither thread ever waits for the other, nor
+// copies the value to exchange it, so buffers like vectors keep their
+// capacity.
+//
+// Writer:
+// ==============================
+// vector<float>& scan = buffer.WriteBuffer();
+// scan.assign(msg.ranges.begin(), msg.ranges.end());
+// buffer.Publish();
+// ==============================
+//
+// Reader:
+// ==============================
+// if (buffer.Update()) Process(buffer.ReadBuffer());
+// ==============================
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : middle_(1), back_(0), front_(2) {}
+
+  explicit TripleBuffer(const T& value) : middle_(1), back_(0), front_(2) {
+    for (Slot& slot : slots_) slot.value = value;
+  }
+
+  // Writer: the buffer to write the next value into. It holds an older
+  // value, which the writer may reuse.
+  T& WriteBuffer() { return slots_[back_].value; }
+
+  // Writer: make the value in the write buffer the latest value.
+  void Publish() {
+    back_ = middle_.exchange(back_ | kNewValue, std::memory_order_acq_rel) &
+        kIndexMask;
+  }
+
+  // Writer: copy value into the write buffer and publish it.
+  void Write(const T& value) {
+    WriteBuffer() = value;
+    Publish();
+  }
+
+  // Reader: move the latest value to the read buffer, if there is one that
+  // the reader has not seen yet. Returns true if there was.
+  bool Update() {
+    if ((middle_.load(std::memory_order_relaxed) & kNewValue) == 0) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  // Reader: the buffer holding the value from the last Update, which stays
+  // valid until the next Update.
+  const T& ReadBuffer() const { return slots_[front_].value; }
+
+  // Reader: the latest value.
+  const T& Read() {
+    Update();
+    return ReadBuffer();
+  }
+
+ private:
+  // Disable copy constructor and assignment operator.
+  TripleBuffer(const TripleBuffer&);
+  void operator=(const TripleBuffer&);
+
+  static const uint8_t kIndexMask = 3;
+  // Set in middle_ when it holds a value that the reader has not seen.
+  static const uint8_t kNewValue = 4;
+
+  // Padded so that the reader and writer do not share cache lines.
+  struct Slot {
+    T value;
+    char padding[64];
+  };
+
+  Slot slots_[3];
+  // Index of the middle buffer, and kNewValue.
+  std::atomic<uint8_t> middle_;
+  char padding0_[64];
+  // Index of the back buffer, only used by the writer.
+  uint8_t back_;
+  char padding1_[64];
+  // Index of the front buffer, only used by the reader.
+  uint8_t front_;
+};
+
+}  // namespace latest_value
+
+#endif  // SRC_UTIL_LATEST_VALUE_H_
@@ -0,0 +1,177 @@
+// Throughput of ThreadSafe<T> against the lock-free latest value cells, with
+// one writer and several readers contending for them.
+//
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "util/latest_value.h"
+#include "util/pthread_utils.h"
+#include "util/timer.h"
+
+using latest_value::SeqLock;
+using latest_value::TripleBuffer;
+using std::atomic;
+using std::function;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+DEFINE_int32(readers, 3, "Number of reader threads");
+DEFINE_double(duration, 1, "Duration of each benchmark, in seconds");
+DEFINE_int32(scan_size, 1081, "Number of ranges in each scan");
+
+// A 2D pose with its timestamp, as the localization publishes it.
+struct Pose {
+  double time;
+  float x;
+  float y;
+  float angle;
+};
+
+struct Reader {
+  // Read the latest value, and return true if it was consistent.
+  function<bool()> read;
+};
+
+// Run write on one thread and the readers on others for FLAGS_duration
+// seconds, and print the number of writes and reads per second.
+void RunBenchmark(const char* name,
+                  const function<void(uint64_t)>& write,
+                  const vector<Reader>& readers) {
+  atomic<bool> run(true);
+  atomic<uint64_t> writes(0);
+  atomic<uint64_t> reads(0);
+  atomic<uint64_t> torn_reads(0);
+  vector<thread> threads;
+  for (const Reader& reader : readers) {
+    threads.push_back(thread([&]() {
+      uint64_t n = 0;
+      uint64_t torn = 0;
+      while (run.load(std::memory_order_relaxed)) {
+        if (!reader.read()) ++torn;
+        ++n;
+      }
+      reads += n;
+      torn_reads += torn;
+    }));
+  }
+  threads.push_back(thread([&]() {
+    uint64_t n = 0;
+    while (run.load(std::memory_order_relaxed)) write(++n);
+    writes = n;
+  }));
+  Sleep(FLAGS_duration);
+  run = false;
+  for (thread& t : threads) t.join();
+  printf("%-24s %10.3f Mwrites/s %10.3f Mreads/s %lu inconsistent\n",
+         name,
+         1e-6 * writes / FLAGS_duration,
+         1e-6 * reads / FLAGS_duration,
+         static_cast<unsigned long>(torn_reads));
+}
+
+// A pose whose fields all come from n, so that readers can check that they
+// did not read parts of different poses.
+Pose MakePose(uint64_t n) {
+  Pose pose;
+  pose.time = n;
+  pose.x = n % 1000;
+  pose.y = n % 1000;
+  pose.angle = n % 1000;
+  return pose;
+}
+
+bool Consistent(const Pose& pose) {
+  return pose.x == static_cast<uint64_t>(pose.time) % 1000 &&
+      pose.x == pose.y && pose.x == pose.angle;
+}
+
+bool Consistent(const vector<float>& scan) {
+  return scan.empty() || scan.front() == scan.back();
+}
+
+void BenchmarkPoses() {
+  ThreadSafe<Pose> thread_safe(MakePose(0));
+  vector<Reader> readers(FLAGS_readers);
+  for (Reader& reader : readers) {
+    reader.read = [&]() { return Consistent(thread_safe.Get()); };
+  }
+  RunBenchmark("ThreadSafe<Pose>",
+               [&](uint64_t n) { thread_safe.Set(MakePose(n)); },
+               readers);
+
+  SeqLock<Pose> seq_lock(MakePose(0));
+  for (Reader& reader : readers) {
+    reader.read = [&]() { return Consistent(seq_lock.Get()); };
+  }
+  RunBenchmark("SeqLock<Pose>",
+               [&](uint64_t n) { seq_lock.Set(MakePose(n)); },
+               readers);
+}
+
+void BenchmarkScans() {
+  const vector<float> scan(FLAGS_scan_size, 0);
+  ThreadSafe<vector<float> > thread_safe(scan);
+  vector<Reader> readers(FLAGS_readers);
+  for (Reader& reader : readers) {
+    reader.read = [&]() { return Consistent(thread_safe.Get()); };
+  }
+  RunBenchmark("ThreadSafe<Scan>",
+               [&](uint64_t n) {
+                 vector<float>& value = thread_safe.GetLock();
+                 value.assign(FLAGS_scan_size, n);
+                 thread_safe.Unlock();
+               },
+               readers);
+
+  // The triple buffer has a single reader, so each reader gets one of its
+  // own, all written by the writer.
+  vector<unique_ptr<TripleBuffer<vector<float> > > > buffers;
+  for (Reader& reader : readers) {
+    buffers.emplace_back(new TripleBuffer<vector<float> >(scan));
+    TripleBuffer<vector<float> >* buffer = buffers.back().get();
+    reader.read = [buffer]() {
+      buffer->Update();
+      return Consistent(buffer->ReadBuffer());
+    };
+  }
+  RunBenchmark("TripleBuffer<Scan> each",
+               [&](uint64_t n) {
+                 for (auto& buffer : buffers) {
+                   buffer->WriteBuffer().assign(FLAGS_scan_size, n);
+                   buffer->Publish();
+                 }
+               },
+               readers);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, false);
+  printf("1 writer, %d readers, %d ranges per scan\n",
+         FLAGS_readers, FLAGS_scan_size);
+  BenchmarkPoses();
+  BenchmarkScans();
+  return 0;
+}
@@ -20,8 +20,102 @@
 //========================================================================
 #include "random.h"
 
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
 #include <random>
 
+namespace {
+
+inline uint64_t RotateLeft(const uint64_t x, const int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+// Number of Box-Muller pairs transformed per block. The random bits of a
+// block are drawn first, so that the transform loop has no dependency on the
+// generator state, and no calls or branches, so that it is vectorized.
+const size_t kBlockPairs = 32;
+
+inline int32_t FloatBits(const float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline float BitsFloat(const int32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// The functions below are branch-free, with the selects done on the bits,
+// since GCC does not if-convert floating point selects under the default
+// -ftrapping-math.
+
+// Natural log of a positive, finite, normal x, to within a few ulp, with the
+// polynomial of the Cephes logf.
+inline float FastLog(const float x) {
+  const int32_t bits = FloatBits(x);
+  const int32_t mantissa = bits & 0x007FFFFF;
+  // x = m * 2^e with m in [sqrt(0.5), sqrt(2)): mantissas below that of
+  // sqrt(0.5) are doubled.
+  const int32_t small = (mantissa < 0x003504F3) ? 1 : 0;
+  const float m = BitsFloat(mantissa | (0x3F000000 + (small << 23))) - 1.0f;
+  const float e = static_cast<float>(((bits >> 23) & 0xFF) - 126 - small);
+  const float z = m * m;
+  float y = 7.0376836292e-2f;
+  y = y * m - 1.1514610310e-1f;
+  y = y * m + 1.1676998740e-1f;
+  y = y * m - 1.2420140846e-1f;
+  y = y * m + 1.4249322787e-1f;
+  y = y * m - 1.6668057665e-1f;
+  y = y * m + 2.0000714765e-1f;
+  y = y * m - 2.4999993993e-1f;
+  y = y * m + 3.3333331174e-1f;
+  y = y * m * z - 2.12194440e-4f * e - 0.5f * z;
+  return m + y + 0.693359375f * e;
+}
+
+// Square root of |x|, to within a few ulp: a reciprocal square root from the
+// bits of x, refined with Newton steps. sqrtf would be a call, for errno. The
+// first estimate is finite, so the square root of 0 is 0.
+inline float FastSqrt(const float x) {
+  const int32_t bits = FloatBits(x) & 0x7FFFFFFF;
+  const float a = BitsFloat(bits);
+  float y = BitsFloat(0x5F3759DF - (bits >> 1));
+  y = y * (1.5f - 0.5f * a * y * y);
+  y = y * (1.5f - 0.5f * a * y * y);
+  y = y * (1.5f - 0.5f * a * y * y);
+  return a * y;
+}
+
+// Sine and cosine of 2 pi bits / 2^24, for bits in [0, 2^24), to within a
+// few ulp. The angle is reduced to the nearest multiple of pi / 2 exactly,
+// in the integer bits, and the rest, in [-pi / 4, pi / 4], goes through the
+// polynomials of the Cephes sinf and cosf.
+inline void FastSinCos(const int32_t bits, float* sin_out, float* cos_out) {
+  const int32_t quadrant = (bits + (1 << 21)) >> 22;
+  const float x = static_cast<float>(bits - (quadrant << 22)) *
+      static_cast<float>(M_PI_2 / (1 << 22));
+  const float z = x * x;
+  const int32_t s = FloatBits(
+      ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) *
+      z * x + x);
+  const int32_t c = FloatBits(
+      ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z +
+       4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f);
+  // Rotate by the quadrant: swap sine and cosine in the odd ones, and flip
+  // their sign bits.
+  const int32_t odd = -(quadrant & 1);
+  const int32_t sin_sign = -((quadrant >> 1) & 1) & INT32_MIN;
+  const int32_t cos_sign = -(((quadrant + 1) >> 1) & 1) & INT32_MIN;
+  *sin_out = BitsFloat(((c & odd) | (s & ~odd)) ^ sin_sign);
+  *cos_out = BitsFloat(((s & odd) | (c & ~odd)) ^ cos_sign);
+}
+
+}  // namespace
+
 
 namespace util_random {
 
@@ -37,4 +131,61 @@ double Random::Gaussian(const double mean, const double stddev) {
   return mean + stddev * randn_(generator_);
 }
 
+void Random::SeedBatch(uint64_t seed) {
+  for (int i = 0; i < 4; ++i) {
+    seed += 0x9E3779B97F4A7C15ull;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    batch_state_[i] = z ^ (z >> 31);
+  }
+}
+
+uint64_t Random::NextBatch() {
+  uint64_t* s = batch_state_;
+  const uint64_t result = s[0] + s[3];
+  const uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = RotateLeft(s[3], 45);
+  return result;
+}
+
+void Random::Gaussians(const float mean,
+                       const float stddev,
+                       const size_t n,
+                       float* values) {
+  const float kScale = 1.0f / 16777216.0f;
+  int32_t bits1[kBlockPairs];
+  int32_t bits2[kBlockPairs];
+  float z[2 * kBlockPairs];
+  for (size_t i = 0; i < n; i += 2 * kBlockPairs) {
+    // Each 64-bit draw gives the top 24 bits of both of its 32-bit halves,
+    // skipping the weak low bits of xoshiro256+.
+    for (size_t j = 0; j < kBlockPairs; ++j) {
+      const uint64_t bits = NextBatch();
+      bits1[j] = static_cast<int32_t>(bits >> 40);
+      bits2[j] = static_cast<int32_t>((bits >> 8) & 0xFFFFFF);
+    }
+    for (size_t j = 0; j < kBlockPairs; ++j) {
+      // u1 is in (0, 1], so that its log is finite.
+      const float u1 = static_cast<float>(bits1[j] + 1) * kScale;
+      const float r = stddev * FastSqrt(-2.0f * FastLog(u1));
+      float sin_theta;
+      float cos_theta;
+      FastSinCos(bits2[j], &sin_theta, &cos_theta);
+      z[2 * j] = mean + r * cos_theta;
+      z[2 * j + 1] = mean + r * sin_theta;
+    }
+    const size_t num_values = (n - i < 2 * kBlockPairs) ?
+        (n - i) : 2 * kBlockPairs;
+    for (size_t j = 0; j < num_values; ++j) {
+      values[i + j] = z[j];
+    }
+  }
+}
+
 }  // namespace util_random
@@ -19,6 +19,9 @@
 // If not, see <http://www.gnu.org/licenses/>.
 //========================================================================
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <random>
 
 #ifndef SRC_UTIL_RANDOM_H_
@@ -28,11 +31,11 @@
 namespace util_random {
 class Random {
  public:
-  Random() : randn_(0, 1.0), randf_(0.0, 1.0) {}
+  Random() : randn_(0, 1.0), randf_(0.0, 1.0) { SeedBatch(0); }
 
   Random(unsigned long seed): generator_(seed),
                               randn_(0, 1.0),
-                              randf_(0.0, 1.0) {}
+                              randf_(0.0, 1.0) { SeedBatch(seed); }
 
   // Generate random numbers between 0 and 1, inclusive.
   double UniformRandom();
@@ -50,8 +53,28 @@ class Random {
   // Return a random value drawn from a Normal distribution.
   double Gaussian(const double mean, const double stddev);
 
+  // Fill values[0 .. n - 1] with independent draws from a Normal distribution.
+  // This is much faster than calling Gaussian() n times: it uses its own
+  // xoshiro256+ generator, seeded from the constructor's seed so that the
+  // sequence is reproducible. The draws are transformed in blocks by a
+  // Box-Muller transform with polynomial log, sine and cosine, which the
+  // compiler vectorizes. The tails are cut off at about 5.8 standard
+  // deviations.
+  void Gaussians(const float mean,
+                 const float stddev,
+                 const size_t n,
+                 float* values);
+
  private:
+  // Seed the state of the batched generator, using splitmix64.
+  void SeedBatch(uint64_t seed);
+
+  // Next 64 random bits from the batched generator.
+  uint64_t NextBatch();
+
   std::default_random_engine generator_;
+  // xoshiro256+ state of the batched generator.
+  uint64_t batch_state_[4];
   std::normal_distribution<double> randn_;
   std::uniform_real_distribution<double> randf_;
 };
@@ -0,0 +1,104 @@
+// Fixed-size thread pool for data-parallel loops.
+//
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+#include "thread_pool.h"
+
+#include <mutex>
+#include <thread>
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace thread_pool {
+
+ThreadPool::ThreadPool(int num_threads) :
+    function_(NULL),
+    fn_(NULL),
+    n_(0),
+    next_(0),
+    generation_(0),
+    workers_busy_(0),
+    stop_(false) {
+  if (num_threads <= 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.push_back(std::thread(&ThreadPool::WorkerMain, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Run(int n, Function function, const void* fn) {
+  if (n <= 0) return;
+  lock_guard<mutex> loop_lock(loop_mutex_);
+  if (workers_.empty() || n == 1) {
+    for (int i = 0; i < n; ++i) function(fn, i);
+    return;
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    function_ = function;
+    fn_ = fn;
+    n_ = n;
+    next_ = 0;
+    workers_busy_ = workers_.size();
+    ++generation_;
+  }
+  start_cv_.notify_all();
+  Work();
+  unique_lock<mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() { return workers_busy_ == 0; });
+}
+
+void ThreadPool::Work() {
+  for (int i = next_++; i < n_; i = next_++) {
+    function_(fn_, i);
+  }
+}
+
+void ThreadPool::WorkerMain() {
+  int generation = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(mutex_);
+      start_cv_.wait(lock, [this, generation]() {
+        return stop_ || generation_ != generation;
+      });
+      if (stop_) return;
+      generation = generation_;
+    }
+    Work();
+    bool done = false;
+    {
+      lock_guard<mutex> lock(mutex_);
+      done = (--workers_busy_ == 0);
+    }
+    if (done) done_cv_.notify_one();
+  }
+}
+
+}  // namespace thread_pool
@@ -0,0 +1,89 @@
+// Fixed-size thread pool for data-parallel loops.
+//
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef SRC_UTIL_THREAD_POOL_H_
+#define SRC_UTIL_THREAD_POOL_H_
+
+namespace thread_pool {
+
+// Worker threads that run the iterations of a loop in parallel. The threads
+// are started once, and wait for work between loops.
+class ThreadPool {
+ public:
+  // Start num_threads - 1 worker threads; the thread calling ParallelFor is
+  // the last one. If num_threads is 0, use one per hardware thread.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  // Number of threads that run loops, including the calling thread.
+  int NumThreads() const { return workers_.size() + 1; }
+
+  // Call fn(i) for every i in [0, n), spread over the threads, and return
+  // once all of the calls are done. Does not allocate. Loops from several
+  // threads are run one at a time.
+  template <typename Fn>
+  void ParallelFor(int n, const Fn& fn) {
+    Run(n, &CallFunction<Fn>, &fn);
+  }
+
+ private:
+  typedef void (*Function)(const void* fn, int i);
+
+  template <typename Fn>
+  static void CallFunction(const void* fn, int i) {
+    (*static_cast<const Fn*>(fn))(i);
+  }
+
+  // Run function(fn, i) for every i in [0, n).
+  void Run(int n, Function function, const void* fn);
+
+  // Run iterations of the current loop until there are none left.
+  void Work();
+
+  // Worker thread main loop.
+  void WorkerMain();
+
+  std::vector<std::thread> workers_;
+
+  // Only one loop runs at a time.
+  std::mutex loop_mutex_;
+
+  // The current loop, and the next iteration to run.
+  Function function_;
+  const void* fn_;
+  int n_;
+  std::atomic<int> next_;
+
+  // Workers wait for a new loop generation, and the caller waits for all of
+  // the workers to finish it.
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  int generation_;
+  int workers_busy_;
+  bool stop_;
+};
+
+}  // namespace thread_pool
+
+#endif  // SRC_UTIL_THREAD_POOL_H_
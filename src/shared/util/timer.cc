@@ -25,10 +25,17 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
 #include <string>
+#include <vector>
 
+using std::atomic;
 using std::max;
+using std::min;
 using std::string;
+using std::vector;
 
 #if defined(__i386__)
 uint64_t RDTSC() {
@@ -44,6 +51,14 @@ uint64_t RDTSC() {
       static_cast<uint64_t>(lo) | (static_cast<uint64_t>(hi) << 32);
   return x;
 }
+#else
+// No cycle counter is read on other architectures: count nanoseconds of the
+// monotonic clock instead.
+uint64_t RDTSC() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
 #endif
 
 double GetWallTime() {
@@ -94,28 +109,138 @@ void FunctionTimer::Lap(int id) {
   t_lap_start_ = t_now;
 }
 
+namespace {
+
+// Registry of all of the cumulative function timers that exist.
+struct TimerRegistry {
+  std::mutex mutex;
+  std::set<const CumulativeFunctionTimer*> timers;
+};
+
+TimerRegistry& GetTimerRegistry() {
+  static TimerRegistry registry;
+  return registry;
+}
+
+// Shard of the cumulative function timers that the calling thread uses.
+// Threads take the shards in turn, so that the first few do not share one.
+int GetTimerShard(int num_shards) {
+  static atomic<int> next_shard(0);
+  static thread_local const int shard = next_shard++;
+  return shard % num_shards;
+}
+
+// Bucket of the run time histogram for a run time of ns nanoseconds.
+int GetHistogramBucket(uint64_t ns, int num_buckets) {
+  int bucket = 0;
+  while (ns > 1 && bucket + 1 < num_buckets) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+}  // namespace
+
 CumulativeFunctionTimer::Invocation::Invocation(
     CumulativeFunctionTimer* cumulative_timer) :
     t_start_(GetMonotonicTime()), cumulative_timer_(cumulative_timer) {}
 
 CumulativeFunctionTimer::Invocation::~Invocation() {
-  const double t_duration = GetMonotonicTime() - t_start_;
-  cumulative_timer_->total_invocations_++;
-  cumulative_timer_->total_run_time_ += t_duration;
+  cumulative_timer_->Add(GetMonotonicTime() - t_start_);
 }
 
 CumulativeFunctionTimer::CumulativeFunctionTimer(const char* name) :
-    name_(name), total_run_time_(0.0), total_invocations_(0) {}
+    name_(name) {
+  for (Shard& shard : shards_) {
+    shard.invocations = 0;
+    shard.total_run_time = 0;
+    shard.min_run_time = UINT64_MAX;
+    shard.max_run_time = 0;
+    for (atomic<uint64_t>& count : shard.histogram) count = 0;
+  }
+  TimerRegistry& registry = GetTimerRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.timers.insert(this);
+}
 
 CumulativeFunctionTimer::~CumulativeFunctionTimer() {
-  const double mean_run_time =
-      total_run_time_ / static_cast<double>(total_invocations_);
+  {
+    TimerRegistry& registry = GetTimerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.timers.erase(this);
+  }
+  Print();
+}
+
+void CumulativeFunctionTimer::Add(double duration) {
+  const uint64_t ns = static_cast<uint64_t>(max(0.0, duration * 1.0E9));
+  Shard& shard = shards_[GetTimerShard(kNumShards)];
+  shard.invocations.fetch_add(1, std::memory_order_relaxed);
+  shard.total_run_time.fetch_add(ns, std::memory_order_relaxed);
+  shard.histogram[GetHistogramBucket(ns, kNumHistogramBuckets)].fetch_add(
+      1, std::memory_order_relaxed);
+  uint64_t old = shard.min_run_time.load(std::memory_order_relaxed);
+  while (ns < old && !shard.min_run_time.compare_exchange_weak(
+      old, ns, std::memory_order_relaxed)) {}
+  old = shard.max_run_time.load(std::memory_order_relaxed);
+  while (ns > old && !shard.max_run_time.compare_exchange_weak(
+      old, ns, std::memory_order_relaxed)) {}
+}
+
+void CumulativeFunctionTimer::GetStats(Stats* stats) const {
+  uint64_t invocations = 0;
+  uint64_t total_run_time = 0;
+  uint64_t min_run_time = UINT64_MAX;
+  uint64_t max_run_time = 0;
+  std::fill(stats->histogram, stats->histogram + kNumHistogramBuckets, 0);
+  for (const Shard& shard : shards_) {
+    invocations += shard.invocations.load(std::memory_order_relaxed);
+    total_run_time += shard.total_run_time.load(std::memory_order_relaxed);
+    min_run_time =
+        min(min_run_time, shard.min_run_time.load(std::memory_order_relaxed));
+    max_run_time =
+        max(max_run_time, shard.max_run_time.load(std::memory_order_relaxed));
+    for (int i = 0; i < kNumHistogramBuckets; ++i) {
+      stats->histogram[i] +=
+          shard.histogram[i].load(std::memory_order_relaxed);
+    }
+  }
+  stats->name = name_;
+  stats->invocations = invocations;
+  stats->total_run_time = 1.0E-9 * static_cast<double>(total_run_time);
+  stats->min_run_time = (invocations == 0) ?
+      0.0 : 1.0E-9 * static_cast<double>(min_run_time);
+  stats->max_run_time = 1.0E-9 * static_cast<double>(max_run_time);
+}
+
+void CumulativeFunctionTimer::Print() const {
+  Stats stats;
+  GetStats(&stats);
   printf("Run-time stats for %s : mean run time = %f ms, "
-         "invocations = %" PRIu64 "\n",
+         "invocations = %" PRIu64 ", min = %f ms, max = %f ms\n",
          name_.c_str(),
-         1.0E3 * mean_run_time,
-         total_invocations_);
+         1.0E3 * stats.MeanRunTime(),
+         stats.invocations,
+         1.0E3 * stats.min_run_time,
+         1.0E3 * stats.max_run_time);
 }
 
+void CumulativeFunctionTimer::GetAllStats(vector<Stats>* stats) {
+  TimerRegistry& registry = GetTimerRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  stats->resize(registry.timers.size());
+  int i = 0;
+  for (const CumulativeFunctionTimer* timer : registry.timers) {
+    timer->GetStats(&(*stats)[i]);
+    ++i;
+  }
+}
 
-
+void CumulativeFunctionTimer::PrintAll() {
+  TimerRegistry& registry = GetTimerRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (const CumulativeFunctionTimer* timer : registry.timers) {
+    timer->Print();
+  }
+}
@@ -21,7 +21,9 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <string>
+#include <vector>
 
 #ifndef SRC_UTIL_TIMER_H_
 #define SRC_UTIL_TIMER_H_
@@ -91,7 +93,11 @@ class FunctionTimer {
 
 // Timer to profile repeated invocations of a function. To use this timer,
 // declare an instance of CumulativeFunctionTimer at a higher scope than the
-// function, and instantiate an Invocation for each function.
+// function, and instantiate an Invocation for each function. Invocations may
+// run on any number of threads at once: each thread adds to one of a fixed
+// set of shards, which are only merged when the statistics are read. All
+// timers are listed in a registry, so that their statistics can be dumped
+// periodically, as well as when each timer is destroyed.
 // Example:
 // ==============================
 // CumulativeFunctionTimer foo_function_timer_("Foo");
@@ -123,6 +129,25 @@ class CumulativeFunctionTimer {
   };
 
  public:
+  // Number of buckets of the run time histogram. Bucket i counts the run
+  // times of [2^i, 2^(i + 1)) nanoseconds, and the last one all longer ones.
+  static const int kNumHistogramBuckets = 40;
+
+  // Statistics of all invocations so far.
+  struct Stats {
+    std::string name;
+    uint64_t invocations;
+    // Run times, in seconds.
+    double total_run_time;
+    double min_run_time;
+    double max_run_time;
+    uint64_t histogram[kNumHistogramBuckets];
+
+    double MeanRunTime() const {
+      return (invocations == 0) ? 0.0 : total_run_time / invocations;
+    }
+  };
+
   // Primary constructor, pass in the function name, or whatever label you wish
   // to identify the timer by.
   explicit CumulativeFunctionTimer(const char* name);
@@ -130,19 +155,47 @@ class CumulativeFunctionTimer {
   // Default destructor. Print statistics of all invocations.
   ~CumulativeFunctionTimer();
 
+  // Get the statistics of all invocations that have finished so far.
+  void GetStats(Stats* stats) const;
+
+  // Print the statistics of all invocations so far.
+  void Print() const;
+
+  // Get the statistics of every timer that currently exists.
+  static void GetAllStats(std::vector<Stats>* stats);
+
+  // Print the statistics of every timer that currently exists.
+  static void PrintAll();
+
  private:
   // Disable copy constructor.
   CumulativeFunctionTimer(const CumulativeFunctionTimer&);
   // Disable default constructor.
   CumulativeFunctionTimer();
 
+  // Add an invocation that ran for duration seconds.
+  void Add(double duration);
+
  private:
+  // Number of shards that threads spread their invocations over.
+  static const int kNumShards = 16;
+
+  // Statistics of the invocations of the threads that use one shard. Only
+  // the threads that share a shard contend on it.
+  struct Shard {
+    std::atomic<uint64_t> invocations;
+    // Run times, in nanoseconds.
+    std::atomic<uint64_t> total_run_time;
+    std::atomic<uint64_t> min_run_time;
+    std::atomic<uint64_t> max_run_time;
+    std::atomic<uint64_t> histogram[kNumHistogramBuckets];
+    // Keeps the shards on separate cache lines.
+    char padding[64];
+  };
+
   // Name of the timer.
   const std::string name_;
-  // Cumulative run time.
-  double total_run_time_;
-  // Number of times the function was invoked.
-  uint64_t total_invocations_;
+  Shard shards_[kNumShards];
 };
 
 #endif  // SRC_UTIL_TIMER_H_
@@ -0,0 +1,503 @@
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include "util/trace.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/timer.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// A trace file is a TraceHeader, followed by TraceRecords, and then, if the
+// recording was stopped, the names of the events and threads and a
+// TraceFooter. The event names are a uint32_t count, followed by a uint16_t
+// id, a uint16_t length and the characters of each name. The thread names
+// are the same, with uint32_t ids.
+const char kTraceFileMagic[8] = "TRACEV1";
+const char kTraceFooterMagic[8] = "TRACEND";
+
+struct TraceHeader {
+  char magic[8];
+  // TSC ticks per second, from a short calibration at the start.
+  double tsc_per_second;
+  // TSC at the start of the recording.
+  uint64_t tsc_start;
+  uint64_t reserved;
+};
+
+enum TracePhase {
+  kTraceBegin = 0,
+  kTraceEnd = 1,
+};
+
+struct TraceRecord {
+  uint64_t tsc;
+  uint32_t thread;
+  uint16_t event;
+  uint16_t phase;
+};
+
+struct TraceFooter {
+  // File offset of the end of the records.
+  uint64_t records_end;
+  // TSC ticks per second, over the whole recording.
+  double tsc_per_second;
+  char magic[8];
+};
+
+// Number of records in each thread's ring buffer, a power of 2.
+const uint64_t kRingSize = 1 << 16;
+
+// How often the flusher writes out the ring buffers.
+const int kFlushIntervalMs = 10;
+
+// Ring buffer of the records of one thread. Only the thread writes records
+// and advances head, and only the flusher advances tail.
+struct Ring {
+  explicit Ring(uint32_t thread) :
+      thread(thread), writing(false), head(0), tail(0), records(kRingSize) {}
+  const uint32_t thread;
+  // Name of the thread, guarded by the recorder's mutex.
+  string name;
+  // Set while the thread is recording an event, so that Stop can wait for
+  // it to finish before the last flush.
+  std::atomic<bool> writing;
+  std::atomic<uint64_t> head;
+  // Keeps head and tail on separate cache lines.
+  char padding[64];
+  std::atomic<uint64_t> tail;
+  vector<TraceRecord> records;
+};
+
+struct Recorder {
+  Recorder() : file(NULL), stop(false), dropped(0) {}
+
+  // Guards everything but the atomics and the contents of the rings.
+  std::mutex mutex;
+  // Rings of every thread that has recorded an event. They are never
+  // deleted, as their threads may record more events at any time.
+  vector<unique_ptr<Ring> > rings;
+  // Names of the events, by id.
+  vector<const char*> events;
+  // Trace file being recorded to, which only the flusher writes to while
+  // recording.
+  FILE* file;
+  std::thread flusher;
+  std::condition_variable flusher_cv;
+  bool stop;
+  uint64_t tsc_start;
+  double t_start;
+  TraceHeader header;
+  std::atomic<uint64_t> dropped;
+};
+
+// The recorder is never destroyed, so that threads can record events while
+// the process exits.
+Recorder& GetRecorder() {
+  static Recorder* recorder = new Recorder();
+  return *recorder;
+}
+
+// Whether events are being recorded, outside of the recorder so that
+// checking it needs no initialization.
+std::atomic<bool> recording(false);
+
+thread_local Ring* thread_ring = NULL;
+thread_local const char* thread_name = NULL;
+
+Ring* GetThreadRing() {
+  if (thread_ring == NULL) {
+    Recorder& recorder = GetRecorder();
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    recorder.rings.emplace_back(new Ring(recorder.rings.size()));
+    thread_ring = recorder.rings.back().get();
+    if (thread_name != NULL) thread_ring->name = thread_name;
+  }
+  return thread_ring;
+}
+
+void Record(uint16_t event, TracePhase phase) {
+  if (!recording.load(std::memory_order_relaxed)) return;
+  Ring* ring = GetThreadRing();
+  // Stop clears recording and then waits for writing to be clear, so either
+  // it waits for this record, or this sees that recording has stopped.
+  ring->writing.store(true, std::memory_order_seq_cst);
+  if (!recording.load(std::memory_order_seq_cst)) {
+    ring->writing.store(false, std::memory_order_release);
+    return;
+  }
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= kRingSize) {
+    GetRecorder().dropped.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    TraceRecord& record = ring->records[head & (kRingSize - 1)];
+    record.tsc = RDTSC();
+    record.thread = ring->thread;
+    record.event = event;
+    record.phase = phase;
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+  ring->writing.store(false, std::memory_order_release);
+}
+
+// Write out the records in all of the rings. Only the flusher calls this.
+void Flush(Recorder* recorder) {
+  vector<Ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(recorder->mutex);
+    for (const unique_ptr<Ring>& ring : recorder->rings) {
+      rings.push_back(ring.get());
+    }
+  }
+  for (Ring* ring : rings) {
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    while (tail != head) {
+      // Write up to the end of the buffer at a time.
+      const uint64_t start = tail & (kRingSize - 1);
+      const uint64_t n = std::min(head - tail, kRingSize - start);
+      fwrite(&ring->records[start], sizeof(TraceRecord), n, recorder->file);
+      tail += n;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+}
+
+void FlusherMain(Recorder* recorder) {
+  std::unique_lock<std::mutex> lock(recorder->mutex);
+  while (!recorder->stop) {
+    recorder->flusher_cv.wait_for(
+        lock, std::chrono::milliseconds(kFlushIntervalMs));
+    lock.unlock();
+    Flush(recorder);
+    lock.lock();
+  }
+}
+
+void WriteName(uint32_t id, bool wide_id, const string& name, FILE* file) {
+  if (wide_id) {
+    fwrite(&id, sizeof(id), 1, file);
+  } else {
+    const uint16_t id16 = id;
+    fwrite(&id16, sizeof(id16), 1, file);
+  }
+  const uint16_t length = std::min<size_t>(name.size(), UINT16_MAX);
+  fwrite(&length, sizeof(length), 1, file);
+  fwrite(name.data(), 1, length, file);
+}
+
+// Reads the values of a trace file in order.
+struct TraceReader {
+  TraceReader(const vector<char>& data, size_t offset, size_t end) :
+      data(data), offset(offset), end(end) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    if (offset + sizeof(T) > end) return false;
+    memcpy(value, &data[offset], sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  // Read a name table entry.
+  template <typename Id>
+  bool ReadName(Id* id, string* name) {
+    uint16_t length = 0;
+    if (!Read(id) || !Read(&length) || offset + length > end) return false;
+    name->assign(&data[offset], length);
+    offset += length;
+    return true;
+  }
+
+  const vector<char>& data;
+  size_t offset;
+  const size_t end;
+};
+
+// Write s as a JSON string.
+void WriteJsonString(const string& s, FILE* file) {
+  fputc('"', file);
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+namespace trace {
+
+uint16_t RegisterEvent(const char* name) {
+  Recorder& recorder = GetRecorder();
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  for (size_t i = 0; i < recorder.events.size(); ++i) {
+    if (strcmp(recorder.events[i], name) == 0) return i;
+  }
+  recorder.events.push_back(name);
+  return recorder.events.size() - 1;
+}
+
+void SetThreadName(const char* name) {
+  thread_name = name;
+  if (thread_ring != NULL) {
+    std::lock_guard<std::mutex> lock(GetRecorder().mutex);
+    thread_ring->name = name;
+  }
+}
+
+bool Start(const string& path) {
+  Recorder& recorder = GetRecorder();
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  if (recorder.file != NULL) return false;
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "ERROR: Unable to write trace file %s\n", path.c_str());
+    return false;
+  }
+  // Calibrate the TSC against the monotonic clock.
+  const double t0 = GetMonotonicTime();
+  const uint64_t tsc0 = RDTSC();
+  Sleep(0.01);
+  const double t1 = GetMonotonicTime();
+  const uint64_t tsc1 = RDTSC();
+  TraceHeader& header = recorder.header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kTraceFileMagic, sizeof(header.magic));
+  header.tsc_per_second = static_cast<double>(tsc1 - tsc0) / (t1 - t0);
+  header.tsc_start = tsc1;
+  fwrite(&header, sizeof(header), 1, file);
+  recorder.file = file;
+  recorder.tsc_start = tsc1;
+  recorder.t_start = t1;
+  recorder.stop = false;
+  recorder.dropped = 0;
+  recording = true;
+  recorder.flusher = std::thread(FlusherMain, &recorder);
+  return true;
+}
+
+void Stop() {
+  Recorder& recorder = GetRecorder();
+  vector<Ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    if (recorder.file == NULL) return;
+    recording.store(false, std::memory_order_seq_cst);
+    recorder.stop = true;
+    for (const unique_ptr<Ring>& ring : recorder.rings) {
+      rings.push_back(ring.get());
+    }
+  }
+  recorder.flusher_cv.notify_all();
+  recorder.flusher.join();
+  // Wait for the events that threads were recording as recording stopped,
+  // so that the last flush writes them. Threads that start recording later
+  // see that recording has stopped, and threads without a ring yet had no
+  // events in flight.
+  for (Ring* ring : rings) {
+    while (ring->writing.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  Flush(&recorder);
+
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  FILE* file = recorder.file;
+  TraceFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.records_end = ftell(file);
+  const uint32_t num_events = recorder.events.size();
+  fwrite(&num_events, sizeof(num_events), 1, file);
+  for (uint32_t i = 0; i < num_events; ++i) {
+    WriteName(i, false, recorder.events[i], file);
+  }
+  const uint32_t num_threads = recorder.rings.size();
+  fwrite(&num_threads, sizeof(num_threads), 1, file);
+  for (const unique_ptr<Ring>& ring : recorder.rings) {
+    WriteName(ring->thread, true, ring->name, file);
+  }
+  // Recalibrate over the whole recording, if it was long enough to be more
+  // accurate than the calibration at the start.
+  const double duration = GetMonotonicTime() - recorder.t_start;
+  footer.tsc_per_second = recorder.header.tsc_per_second;
+  if (duration > 1.0) {
+    footer.tsc_per_second =
+        static_cast<double>(RDTSC() - recorder.tsc_start) / duration;
+  }
+  memcpy(footer.magic, kTraceFooterMagic, sizeof(footer.magic));
+  fwrite(&footer, sizeof(footer), 1, file);
+  fclose(file);
+  recorder.file = NULL;
+}
+
+void Begin(uint16_t event) {
+  Record(event, kTraceBegin);
+}
+
+void End(uint16_t event) {
+  Record(event, kTraceEnd);
+}
+
+uint64_t NumDroppedEvents() {
+  return GetRecorder().dropped.load();
+}
+
+bool ConvertToChromeJson(const string& trace_path, const string& json_path) {
+  FILE* in = fopen(trace_path.c_str(), "rb");
+  if (in == NULL) {
+    fprintf(stderr, "ERROR: Unable to read trace file %s\n",
+            trace_path.c_str());
+    return false;
+  }
+  vector<char> data;
+  char buffer[1 << 16];
+  size_t n = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(in);
+
+  TraceHeader header;
+  TraceReader header_reader(data, 0, data.size());
+  if (!header_reader.Read(&header) ||
+      memcmp(header.magic, kTraceFileMagic, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "ERROR: %s is not a trace file\n", trace_path.c_str());
+    return false;
+  }
+
+  // Without a footer, the process died while recording: take everything
+  // that is there as records.
+  size_t records_end = sizeof(header) +
+      (data.size() - sizeof(header)) / sizeof(TraceRecord) *
+      sizeof(TraceRecord);
+  double tsc_per_second = header.tsc_per_second;
+  vector<string> event_names;
+  vector<string> thread_names;
+  TraceFooter footer;
+  TraceReader footer_reader(
+      data, data.size() - std::min(data.size(), sizeof(footer)), data.size());
+  if (footer_reader.Read(&footer) &&
+      memcmp(footer.magic, kTraceFooterMagic, sizeof(footer.magic)) == 0 &&
+      footer.records_end >= sizeof(header) &&
+      footer.records_end <= data.size() - sizeof(footer)) {
+    records_end = footer.records_end;
+    tsc_per_second = footer.tsc_per_second;
+    TraceReader reader(data, records_end, data.size() - sizeof(footer));
+    uint32_t num_events = 0;
+    reader.Read(&num_events);
+    for (uint32_t i = 0; i < num_events; ++i) {
+      uint16_t id = 0;
+      string name;
+      if (!reader.ReadName(&id, &name)) break;
+      if (id >= event_names.size()) event_names.resize(id + 1);
+      event_names[id] = name;
+    }
+    uint32_t num_threads = 0;
+    reader.Read(&num_threads);
+    for (uint32_t i = 0; i < num_threads; ++i) {
+      uint32_t id = 0;
+      string name;
+      if (!reader.ReadName(&id, &name)) break;
+      if (id >= thread_names.size()) thread_names.resize(id + 1);
+      thread_names[id] = name;
+    }
+  }
+
+  FILE* out = fopen(json_path.c_str(), "w");
+  if (out == NULL) {
+    fprintf(stderr, "ERROR: Unable to write %s\n", json_path.c_str());
+    return false;
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (size_t i = 0; i < thread_names.size(); ++i) {
+    if (thread_names[i].empty()) continue;
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+            "\"tid\":%zu,\"args\":{\"name\":", first ? "" : ",\n", i);
+    WriteJsonString(thread_names[i], out);
+    fprintf(out, "}}");
+    first = false;
+  }
+  // Events that have begun but not ended on each thread, innermost last.
+  // Events are dropped when a ring is full, so an end may have lost its
+  // begin, or an event inside it may have lost its end.
+  vector<vector<uint16_t> > open_events;
+  const auto write_event = [&](uint16_t event, bool begin, double t,
+                               uint32_t thread) {
+    const string name = (event < event_names.size()) ?
+        event_names[event] : "event " + std::to_string(event);
+    fprintf(out, "%s{\"name\":", first ? "" : ",\n");
+    WriteJsonString(name, out);
+    fprintf(out, ",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":0,\"tid\":%u}",
+            begin ? "B" : "E",
+            t,
+            thread);
+    first = false;
+  };
+  TraceReader reader(data, sizeof(header), records_end);
+  TraceRecord record;
+  while (reader.Read(&record)) {
+    // Events recorded before the calibration finished are clamped to 0.
+    const double t = (record.tsc > header.tsc_start) ?
+        1.0E6 * static_cast<double>(record.tsc - header.tsc_start) /
+        tsc_per_second : 0.0;
+    if (record.thread >= open_events.size()) {
+      open_events.resize(record.thread + 1);
+    }
+    vector<uint16_t>& open = open_events[record.thread];
+    if (record.phase == kTraceBegin) {
+      open.push_back(record.event);
+      write_event(record.event, true, t, record.thread);
+      continue;
+    }
+    // Drop an end without a begin. Events inside this one that lost their
+    // ends end with it.
+    const auto it = std::find(open.rbegin(), open.rend(), record.event);
+    if (it == open.rend()) continue;
+    const size_t depth = open.rend() - it - 1;
+    while (open.size() > depth) {
+      write_event(open.back(), false, t, record.thread);
+      open.pop_back();
+    }
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+  return true;
+}
+
+}  // namespace trace
@@ -0,0 +1,98 @@
+// Low overhead tracing of scoped events, with timestamps from the CPU TSC.
+//
+//========================================================================
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+
+#include <stdint.h>
+
+#include <string>
+
+#ifndef SRC_UTIL_TRACE_H_
+#define SRC_UTIL_TRACE_H_
+
+namespace trace {
+
+// Each thread records the begin and end of its events into a ring buffer of
+// its own, which it alone writes and only the flusher thread reads, so
+// recording takes no locks. While recording, the flusher regularly appends
+// the rings' contents to a binary trace file, which ConvertToChromeJson
+// turns into a trace that chrome://tracing and Perfetto can show. Events are
+// dropped if a ring fills up faster than the flusher empties it.
+//
+// To trace a scope, use TRACE_SCOPE("Name") at its start:
+// ==============================
+// void LaserCallback(const sensor_msgs::LaserScan& msg) {
+//   TRACE_SCOPE("LaserCallback");
+//   // ... Do some stuff ...
+// }
+// ==============================
+
+// Get the id of the event named name, which must stay valid for as long as
+// the process runs, as string literals do. Every call with the same name
+// returns the same id.
+uint16_t RegisterEvent(const char* name);
+
+// Name the calling thread in the trace.
+void SetThreadName(const char* name);
+
+// Start recording events to the trace file at path, replacing it. Returns
+// false if it cannot be written, or if recording has already started.
+bool Start(const std::string& path);
+
+// Stop recording, and write out all of the events recorded so far.
+void Stop();
+
+// Record the start or end of an event on the calling thread, if recording.
+void Begin(uint16_t event);
+void End(uint16_t event);
+
+// Number of events dropped because a ring buffer was full, since Start.
+uint64_t NumDroppedEvents();
+
+// Convert the binary trace file at trace_path into Chrome trace event JSON
+// at json_path. Traces of processes that died before Stop can be converted
+// too, with numbers in place of the event names. Ends whose begins were
+// dropped are left out, so that every end matches a begin. Returns false on
+// error.
+bool ConvertToChromeJson(const std::string& trace_path,
+                         const std::string& json_path);
+
+// Records the begin of an event when it is created, and the end when it is
+// destroyed.
+class ScopedEvent {
+ public:
+  explicit ScopedEvent(uint16_t event) : event_(event) { Begin(event_); }
+  ~ScopedEvent() { End(event_); }
+
+ private:
+  // Disable copy constructor.
+  ScopedEvent(const ScopedEvent&);
+
+  const uint16_t event_;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Trace the rest of the enclosing scope as the event name.
+#define TRACE_SCOPE(name) \
+  static const uint16_t TRACE_CONCAT(trace_event_, __LINE__) = \
+      trace::RegisterEvent(name); \
+  trace::ScopedEvent TRACE_CONCAT(trace_scope_, __LINE__)( \
+      TRACE_CONCAT(trace_event_, __LINE__))
+
+#endif  // SRC_UTIL_TRACE_H_
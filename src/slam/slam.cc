@@ -381,12 +381,25 @@ void SLAM::MotionModel(Eigen::Vector2f loc, float angle, float dist, float delta
   // Reference CS393r Lecture Slides "13 - Simultaneous Localization and Mapping" Slides 13 & 14
   // Because we don't know where we are, where we start, which way we are facing
   // all options have to be considered, hence 3D table
-  for(int i_x=0; i_x < num_x_; i_x++){
-    float deviation_x = variance_x + rng_.Gaussian(0, variance_x);  // Check if correct?
-    for(int i_y=0; i_y < num_y_; i_y++){
-      float deviation_y = variance_y + rng_.Gaussian(0, variance_y); 
-      for(int i_angle=0; i_angle < num_angle_; i_angle++){
-        float deviation_angle = variance_angle + rng_.Gaussian(0, variance_angle); 
+  const int num_x = num_x_;
+  const int num_y = num_y_;
+  const int num_angle = num_angle_;
+
+  // Draw the noise of every candidate in one pass
+  noise_x_.resize(num_x);
+  noise_y_.resize(num_x * num_y);
+  noise_angle_.resize(num_x * num_y * num_angle);
+  rng_.Gaussians(0, variance_x, noise_x_.size(), noise_x_.data());
+  rng_.Gaussians(0, variance_y, noise_y_.size(), noise_y_.data());
+  rng_.Gaussians(0, variance_angle, noise_angle_.size(), noise_angle_.data());
+
+  for(int i_x=0; i_x < num_x; i_x++){
+    float deviation_x = variance_x + noise_x_[i_x];  // Check if correct?
+    for(int i_y=0; i_y < num_y; i_y++){
+      const int i_xy = i_x * num_y + i_y;
+      float deviation_y = variance_y + noise_y_[i_xy]; 
+      for(int i_angle=0; i_angle < num_angle; i_angle++){
+        float deviation_angle = variance_angle + noise_angle_[i_xy * num_angle + i_angle]; 
 
         float new_location_x = loc.x() + deviation_x*cos(angle) - deviation_y*sin(angle); // + epsilon_x <- added in deviation
         float new_location_y = loc.y() + deviation_x*sin(angle) + deviation_y*cos(angle); // + epsilon_y
@@ -121,6 +121,11 @@ class SLAM {
   // Random number generator.
   util_random::Random rng_;
 
+  // Motion model noise, drawn in one batch per call.
+  std::vector<float> noise_x_;
+  std::vector<float> noise_y_;
+  std::vector<float> noise_angle_;
+
   // tunable parameters: CSM
   float max_particle_cost_;
   float observation_weight_;
@@ -46,6 +46,7 @@
 #include "shared/math/math_util.h"
 #include "shared/math/line2d.h"
 #include "shared/util/timer.h"
+#include "shared/util/trace.h"
 
 #include "slam.h"
 #include "vector_map/vector_map.h"
@@ -69,6 +70,10 @@ using visualization::DrawParticle;
 // Create command line arguements
 DEFINE_string(laser_topic, "/scan", "Name of ROS topic for LIDAR data");
 DEFINE_string(odom_topic, "/odom", "Name of ROS topic for odometry data");
+DEFINE_string(trace_file,
+              "",
+              "If set, record a trace of the callbacks to this file, to "
+              "convert with trace_converter");
 
 DECLARE_int32(v);
 
@@ -117,6 +122,7 @@ void PublishPose() {
 }
 
 void LaserCallback(const sensor_msgs::LaserScan& msg) {
+  TRACE_SCOPE("LaserCallback");
   if (FLAGS_v > 0) {
     printf("Laser t=%f\n", msg.header.stamp.toSec());
   }
@@ -132,6 +138,7 @@ void LaserCallback(const sensor_msgs::LaserScan& msg) {
 }
 
 void OdometryCallback(const nav_msgs::Odometry& msg) {
+  TRACE_SCOPE("OdometryCallback");
   if (FLAGS_v > 0) {
     printf("Odometry t=%f\n", msg.header.stamp.toSec());
   }
@@ -161,7 +168,12 @@ int main(int argc, char** argv) {
       FLAGS_odom_topic.c_str(),
       1,
       OdometryCallback);
+  if (!FLAGS_trace_file.empty()) {
+    trace::SetThreadName("main");
+    trace::Start(FLAGS_trace_file);
+  }
   ros::spin();
+  trace::Stop();
 
   return 0;
 }
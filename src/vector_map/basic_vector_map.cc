@@ -0,0 +1,165 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    basic_vector_map.cc
+\brief   Vector map lines and queries, templated on the coordinate type.
+*/
+//========================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/line2d.h"
+#include "basic_vector_map.h"
+
+using geometry::Line;
+using std::max;
+using std::min;
+using std::string;
+using std::vector;
+
+namespace {
+
+// True if the segment p2-p3 intersects or touches l.
+template <typename T>
+bool SegmentsIntersect(const Line<T>& l,
+                       const Eigen::Matrix<T, 2, 1>& p2,
+                       const Eigen::Matrix<T, 2, 1>& p3) {
+  return l.Intersects(p2, p3);
+}
+
+// Twice the signed area of the triangle a, b, c, which is exact for fixed
+// point coordinates within kMaxFixedPointCoordinate. Larger ones could
+// overflow.
+int64_t Orientation(const Eigen::Matrix<int32_t, 2, 1>& a,
+                    const Eigen::Matrix<int32_t, 2, 1>& b,
+                    const Eigen::Matrix<int32_t, 2, 1>& c) {
+  const int64_t bx = static_cast<int64_t>(b.x()) - a.x();
+  const int64_t by = static_cast<int64_t>(b.y()) - a.y();
+  const int64_t cx = static_cast<int64_t>(c.x()) - a.x();
+  const int64_t cy = static_cast<int64_t>(c.y()) - a.y();
+  return bx * cy - by * cx;
+}
+
+// True if a and b are both strictly on the same side of zero.
+bool SameSide(int64_t a, int64_t b) {
+  return (a > 0 && b > 0) || (a < 0 && b < 0);
+}
+
+// Same test as Line::Intersects, with the cross products in 64 bits, which
+// neither overflow nor round for coordinates within
+// kMaxFixedPointCoordinate.
+template <>
+bool SegmentsIntersect<int32_t>(const Line<int32_t>& l,
+                                const Eigen::Matrix<int32_t, 2, 1>& p2,
+                                const Eigen::Matrix<int32_t, 2, 1>& p3) {
+  const Eigen::Matrix<int32_t, 2, 1>& p0 = l.p0;
+  const Eigen::Matrix<int32_t, 2, 1>& p1 = l.p1;
+  if (min(p0.x(), p1.x()) > max(p2.x(), p3.x())) return false;
+  if (max(p0.x(), p1.x()) < min(p2.x(), p3.x())) return false;
+  if (min(p0.y(), p1.y()) > max(p2.y(), p3.y())) return false;
+  if (max(p0.y(), p1.y()) < min(p2.y(), p3.y())) return false;
+  if (SameSide(Orientation(p0, p1, p3), Orientation(p0, p1, p2))) {
+    return false;
+  }
+  return !SameSide(Orientation(p2, p3, p1), Orientation(p2, p3, p0));
+}
+
+}  // namespace
+
+namespace vector_map {
+
+template <typename T>
+void CullLines(const vector<Line<T> >& lines,
+               const Eigen::Matrix<T, 2, 1>& loc,
+               T max_range,
+               vector<Line<T> >* lines_list) {
+  const T x_min = loc.x() - max_range;
+  const T y_min = loc.y() - max_range;
+  const T x_max = loc.x() + max_range;
+  const T y_max = loc.y() + max_range;
+  lines_list->clear();
+  for (const Line<T>& l : lines) {
+    if (l.p0.x() < x_min && l.p1.x() < x_min) continue;
+    if (l.p0.y() < y_min && l.p1.y() < y_min) continue;
+    if (l.p0.x() > x_max && l.p1.x() > x_max) continue;
+    if (l.p0.y() > y_max && l.p1.y() > y_max) continue;
+    lines_list->push_back(l);
+  }
+}
+
+template <typename T>
+bool BasicVectorMap<T>::LoadLines(const string& file) {
+  FILE* fid = fopen(file.c_str(), "r");
+  if (fid == NULL) return false;
+  lines.clear();
+  double x0(0), y0(0), x1(0), y1(0);
+  while (fscanf(fid, "%lf,%lf,%lf,%lf", &x0, &y0, &x1, &y1) == 4) {
+    if (!MapScalar<T>::InRange(x0) || !MapScalar<T>::InRange(y0) ||
+        !MapScalar<T>::InRange(x1) || !MapScalar<T>::InRange(y1)) {
+      fprintf(stderr, "ERROR: Map %s has a line out of the coordinate range: "
+              "%f,%f,%f,%f\n", file.c_str(), x0, y0, x1, y1);
+      fclose(fid);
+      lines.clear();
+      return false;
+    }
+    lines.push_back(LineT(MapScalar<T>::FromMeters(x0),
+                          MapScalar<T>::FromMeters(y0),
+                          MapScalar<T>::FromMeters(x1),
+                          MapScalar<T>::FromMeters(y1)));
+  }
+  fclose(fid);
+  return true;
+}
+
+template <typename T>
+void BasicVectorMap<T>::GetSceneLines(const Vector2T& loc,
+                                      T max_range,
+                                      vector<LineT>* lines_list) const {
+  CullLines(lines, loc, max_range, lines_list);
+}
+
+template <typename T>
+bool BasicVectorMap<T>::Intersects(const Vector2T& v0,
+                                   const Vector2T& v1) const {
+  for (const LineT& l : lines) {
+    if (SegmentsIntersect(l, v0, v1)) return true;
+  }
+  return false;
+}
+
+template void CullLines<float>(const vector<Line<float> >&,
+                               const Eigen::Matrix<float, 2, 1>&,
+                               float,
+                               vector<Line<float> >*);
+template void CullLines<double>(const vector<Line<double> >&,
+                                const Eigen::Matrix<double, 2, 1>&,
+                                double,
+                                vector<Line<double> >*);
+template void CullLines<int32_t>(const vector<Line<int32_t> >&,
+                                 const Eigen::Matrix<int32_t, 2, 1>&,
+                                 int32_t,
+                                 vector<Line<int32_t> >*);
+
+template struct BasicVectorMap<float>;
+template struct BasicVectorMap<double>;
+template struct BasicVectorMap<int32_t>;
+
+}  // namespace vector_map
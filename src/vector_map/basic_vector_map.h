@@ -0,0 +1,136 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    basic_vector_map.h
+\brief   Vector map lines and queries, templated on the coordinate type.
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "glog/logging.h"
+#include "math/line2d.h"
+
+#ifndef BASIC_VECTOR_MAP_H
+#define BASIC_VECTOR_MAP_H
+
+namespace vector_map {
+
+// Fixed point map coordinates are in units of 1 / kFixedPointScale meters.
+const double kFixedPointScale = 1024;
+
+// Largest magnitude of a fixed point coordinate, about 1048 km. Differences
+// of coordinates within it fit in 31 bits, so the 64 bit cross products of
+// the intersection tests can not overflow.
+const int32_t kMaxFixedPointCoordinate = (1 << 30) - 1;
+
+// Conversion of map coordinates of type T from and to meters, and the type
+// that products of coordinates are computed in. Floating point coordinates
+// are in meters.
+template <typename T>
+struct MapScalar {
+  typedef T Wide;
+  // True if x meters can be represented.
+  static bool InRange(double x) { return true; }
+  static T FromMeters(double x) { return static_cast<T>(x); }
+  static double ToMeters(T x) { return static_cast<double>(x); }
+};
+
+template <>
+struct MapScalar<int32_t> {
+  typedef int64_t Wide;
+  static bool InRange(double x) {
+    return std::fabs(x * kFixedPointScale) <= kMaxFixedPointCoordinate;
+  }
+  static int32_t FromMeters(double x) {
+    CHECK(InRange(x)) << x << " m is out of the range of fixed point map "
+                      << "coordinates";
+    return static_cast<int32_t>(std::lround(x * kFixedPointScale));
+  }
+  static double ToMeters(int32_t x) {
+    return static_cast<double>(x) / kFixedPointScale;
+  }
+};
+
+// Lines of lines that may be within max_range of loc, in the same order.
+template <typename T>
+void CullLines(const std::vector<geometry::Line<T> >& lines,
+               const Eigen::Matrix<T, 2, 1>& loc,
+               T max_range,
+               std::vector<geometry::Line<T> >* lines_list);
+
+// The lines of a vector map, with the queries that do not depend on angles,
+// for float, double and int32_t fixed point coordinates. Double keeps
+// campus-scale maps with origins far from zero precise. Fixed point
+// intersection tests are exact, and the same on every machine.
+template <typename T>
+struct BasicVectorMap {
+  typedef Eigen::Matrix<T, 2, 1> Vector2T;
+  typedef geometry::Line<T> LineT;
+
+  BasicVectorMap() {}
+  explicit BasicVectorMap(const std::vector<LineT>& lines) : lines(lines) {}
+
+  // Convert a map with coordinates of another type.
+  template <typename U>
+  explicit BasicVectorMap(const BasicVectorMap<U>& other) {
+    lines.reserve(other.lines.size());
+    for (const geometry::Line<U>& l : other.lines) {
+      lines.push_back(LineT(
+          Convert<U>(l.p0.x()), Convert<U>(l.p0.y()),
+          Convert<U>(l.p1.x()), Convert<U>(l.p1.y())));
+    }
+  }
+
+  // Load the lines of a map in the text format, one "x0,y0,x1,y1" line per
+  // line segment, parsed in double precision. The lines are not cleaned up.
+  // Returns false if the file cannot be read, or has coordinates out of the
+  // range of T.
+  bool LoadLines(const std::string& file);
+
+  // Get the lines that may be within max_range of loc.
+  void GetSceneLines(const Vector2T& loc,
+                     T max_range,
+                     std::vector<LineT>* lines_list) const;
+
+  // True if the segment v0-v1 intersects or touches any line. Fixed point
+  // coordinates must be within kMaxFixedPointCoordinate, as FromMeters
+  // ensures.
+  bool Intersects(const Vector2T& v0, const Vector2T& v1) const;
+
+  std::vector<LineT> lines;
+
+ private:
+  template <typename U>
+  static T Convert(U x) {
+    return MapScalar<T>::FromMeters(MapScalar<U>::ToMeters(x));
+  }
+};
+
+extern template struct BasicVectorMap<float>;
+extern template struct BasicVectorMap<double>;
+extern template struct BasicVectorMap<int32_t>;
+
+typedef BasicVectorMap<double> VectorMapd;
+typedef BasicVectorMap<int32_t> VectorMapFixed;
+
+}  // namespace vector_map
+
+#endif  // BASIC_VECTOR_MAP_H
@@ -0,0 +1,259 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    distance_map.cc
+\brief   Distance from points and segments to the nearest map line.
+*/
+//========================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/distance_transform.h"
+#include "math/geometry.h"
+#include "math/line2d.h"
+#include "util/thread_pool.h"
+#include "distance_map.h"
+
+using distance_transform::kInf;
+using distance_transform::SquaredDistanceTransform2D;
+using Eigen::Vector2f;
+using geometry::line2f;
+using std::max;
+using std::min;
+using std::swap;
+using std::vector;
+
+namespace {
+
+// Size of the cells of the line index, in meters.
+const float kIndexCellSize = 1.0;
+
+// Number of points that each task of a parallel batch query handles.
+const int kBatchChunkSize = 256;
+
+int Clamp(int x, int lo, int hi) {
+  return max(lo, min(hi, x));
+}
+
+// Call fn(i) for the index i of every cell of a width x height grid, of
+// cell_size cells starting at origin, that the line l passes through. The
+// line must be within the grid.
+template <typename Fn>
+void ForEachCellOnLine(const line2f& l,
+                       const Vector2f& origin,
+                       float cell_size,
+                       int width,
+                       int height,
+                       const Fn& fn) {
+  const Vector2f p0 = (l.p0 - origin) / cell_size;
+  const Vector2f p1 = (l.p1 - origin) / cell_size;
+  const Vector2f d = p1 - p0;
+  const int y_min = Clamp(floor(min(p0.y(), p1.y())), 0, height - 1);
+  const int y_max = Clamp(floor(max(p0.y(), p1.y())), 0, height - 1);
+  for (int y = y_min; y <= y_max; ++y) {
+    // Part of the line within this row of cells.
+    float t0 = 0;
+    float t1 = 1;
+    if (d.y() != 0) {
+      t0 = (static_cast<float>(y) - p0.y()) / d.y();
+      t1 = (static_cast<float>(y + 1) - p0.y()) / d.y();
+      if (t0 > t1) swap(t0, t1);
+      t0 = max(t0, 0.0f);
+      t1 = min(t1, 1.0f);
+    }
+    const float x0 = p0.x() + t0 * d.x();
+    const float x1 = p0.x() + t1 * d.x();
+    const int x_min = Clamp(floor(min(x0, x1)), 0, width - 1);
+    const int x_max = Clamp(floor(max(x0, x1)), 0, width - 1);
+    for (int x = x_min; x <= x_max; ++x) fn(y * width + x);
+  }
+}
+
+}  // namespace
+
+namespace vector_map {
+
+DistanceMap::DistanceMap() :
+    origin_(0, 0),
+    resolution_(1),
+    width_(0),
+    height_(0),
+    index_width_(0),
+    index_height_(0) {}
+
+void DistanceMap::Build(const vector<line2f>& lines,
+                        float resolution,
+                        float margin) {
+  lines_ = lines;
+  distance_.clear();
+  index_start_.clear();
+  index_lines_.clear();
+  if (lines_.empty()) return;
+
+  // Size the raster to the bounding box of the map.
+  Vector2f box_min = lines_[0].p0;
+  Vector2f box_max = lines_[0].p0;
+  for (const line2f& l : lines_) {
+    box_min = box_min.cwiseMin(l.p0).cwiseMin(l.p1);
+    box_max = box_max.cwiseMax(l.p0).cwiseMax(l.p1);
+  }
+  resolution_ = resolution;
+  origin_ = box_min - Vector2f(margin, margin);
+  const Vector2f size = box_max - box_min + Vector2f(2 * margin, 2 * margin);
+  width_ = static_cast<int>(ceil(size.x() / resolution_)) + 1;
+  height_ = static_cast<int>(ceil(size.y() / resolution_)) + 1;
+
+  // Mark every raster cell that a line passes through, and take the distance
+  // transform.
+  vector<double> sq_distance(width_ * height_, kInf);
+  for (const line2f& l : lines_) {
+    ForEachCellOnLine(l, origin_, resolution_, width_, height_,
+                      [&sq_distance](int cell) { sq_distance[cell] = 0; });
+  }
+  SquaredDistanceTransform2D(width_, height_, &sq_distance);
+  distance_.resize(width_ * height_);
+  for (size_t i = 0; i < distance_.size(); ++i) {
+    distance_[i] = resolution_ * sqrt(sq_distance[i]);
+  }
+
+  // Index of the lines through each cell of a coarser grid, built by
+  // counting the lines in each cell, and then filling them in.
+  index_width_ =
+      static_cast<int>(ceil(width_ * resolution_ / kIndexCellSize)) + 1;
+  index_height_ =
+      static_cast<int>(ceil(height_ * resolution_ / kIndexCellSize)) + 1;
+  index_start_.assign(index_width_ * index_height_ + 1, 0);
+  for (const line2f& l : lines_) {
+    ForEachCellOnLine(l, origin_, kIndexCellSize, index_width_, index_height_,
+                      [this](int cell) { ++index_start_[cell + 1]; });
+  }
+  for (size_t i = 1; i < index_start_.size(); ++i) {
+    index_start_[i] += index_start_[i - 1];
+  }
+  index_lines_.resize(index_start_.back());
+  vector<int> next(index_start_.begin(), index_start_.end() - 1);
+  for (size_t i = 0; i < lines_.size(); ++i) {
+    ForEachCellOnLine(lines_[i], origin_, kIndexCellSize,
+                      index_width_, index_height_,
+                      [this, &next, i](int cell) {
+                        index_lines_[next[cell]++] = i;
+                      });
+  }
+}
+
+int DistanceMap::RasterCell(const Vector2f& p) const {
+  const Vector2f c = (p - origin_) / resolution_;
+  const int x = Clamp(floor(c.x()), 0, width_ - 1);
+  const int y = Clamp(floor(c.y()), 0, height_ - 1);
+  return y * width_ + x;
+}
+
+float DistanceMap::ApproximateDistance(const Vector2f& p) const {
+  if (Empty()) return std::numeric_limits<float>::infinity();
+  return distance_[RasterCell(p)];
+}
+
+float DistanceMap::DistanceBound(const Vector2f& p) const {
+  // A line passes within half a cell diagonal of the center of every marked
+  // cell, and p is within half a cell diagonal of the center of its own, so
+  // the nearest line is at most a cell diagonal further than the raster
+  // says. Outside of the raster, add the distance to the nearest cell.
+  const int cell = RasterCell(p);
+  const Vector2f corner = origin_ + resolution_ * Vector2f(
+      static_cast<float>(cell % width_), static_cast<float>(cell / width_));
+  const Vector2f nearest = p.cwiseMax(corner).cwiseMin(
+      corner + Vector2f(resolution_, resolution_));
+  const float bound = distance_[cell] + M_SQRT2 * resolution_ +
+      (p - nearest).norm();
+  // Leave room for rounding.
+  return 1.001f * bound + 1e-3f;
+}
+
+float DistanceMap::MinDistance(const Vector2f& p0,
+                               const Vector2f& p1,
+                               float bound) const {
+  const bool is_point = (p0 == p1);
+  const Vector2f box_min =
+      (p0.cwiseMin(p1) - Vector2f(bound, bound) - origin_) / kIndexCellSize;
+  const Vector2f box_max =
+      (p0.cwiseMax(p1) + Vector2f(bound, bound) - origin_) / kIndexCellSize;
+  const int x_min = Clamp(floor(box_min.x()), 0, index_width_ - 1);
+  const int y_min = Clamp(floor(box_min.y()), 0, index_height_ - 1);
+  const int x_max = Clamp(floor(box_max.x()), 0, index_width_ - 1);
+  const int y_max = Clamp(floor(box_max.y()), 0, index_height_ - 1);
+  float min_distance = std::numeric_limits<float>::infinity();
+  for (int y = y_min; y <= y_max; ++y) {
+    for (int x = x_min; x <= x_max; ++x) {
+      const int cell = y * index_width_ + x;
+      for (int i = index_start_[cell]; i < index_start_[cell + 1]; ++i) {
+        const line2f& l = lines_[index_lines_[i]];
+        float d;
+        if (is_point) {
+          d = (p0 - geometry::ProjectPointOntoLineSegment(p0, l.p0, l.p1))
+              .norm();
+        } else {
+          d = geometry::MinDistanceLineLine(p0, p1, l.p0, l.p1);
+        }
+        min_distance = min(min_distance, d);
+      }
+      if (min_distance == 0) return 0;
+    }
+  }
+  return min_distance;
+}
+
+float DistanceMap::Distance(const Vector2f& p) const {
+  if (Empty()) return std::numeric_limits<float>::infinity();
+  return MinDistance(p, p, DistanceBound(p));
+}
+
+void DistanceMap::Distances(const Vector2f* points,
+                            int num_points,
+                            float* distances,
+                            thread_pool::ThreadPool* pool) const {
+  const auto query_chunk = [&](int chunk) {
+    const int end = min(num_points, (chunk + 1) * kBatchChunkSize);
+    for (int i = chunk * kBatchChunkSize; i < end; ++i) {
+      distances[i] = Distance(points[i]);
+    }
+  };
+  const int num_chunks = (num_points + kBatchChunkSize - 1) / kBatchChunkSize;
+  if (pool == NULL) {
+    for (int i = 0; i < num_chunks; ++i) query_chunk(i);
+  } else {
+    pool->ParallelFor(num_chunks, query_chunk);
+  }
+}
+
+float DistanceMap::SegmentDistance(const Vector2f& p0,
+                                   const Vector2f& p1) const {
+  if (Empty()) return std::numeric_limits<float>::infinity();
+  // The distance bound at any point along the segment bounds the segment's
+  // distance, so take the tightest of a few, one per index cell.
+  const int num_samples =
+      static_cast<int>(ceil((p1 - p0).norm() / kIndexCellSize)) + 1;
+  float bound = DistanceBound(p0);
+  for (int i = 1; i <= num_samples; ++i) {
+    const float t = static_cast<float>(i) / static_cast<float>(num_samples);
+    bound = min(bound, DistanceBound(p0 + t * (p1 - p0)));
+  }
+  return MinDistance(p0, p1, bound);
+}
+
+}  // namespace vector_map
@@ -0,0 +1,115 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    distance_map.h
+\brief   Distance from points and segments to the nearest map line.
+*/
+//========================================================================
+
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/line2d.h"
+
+#ifndef DISTANCE_MAP_H
+#define DISTANCE_MAP_H
+
+namespace thread_pool {
+class ThreadPool;
+}  // namespace thread_pool
+
+namespace vector_map {
+
+// Answers "how far is the nearest map line?" for points and segments. A
+// raster of the distance from every cell to the nearest line, computed once
+// by Build, gives an approximate answer in constant time. It also bounds the
+// search for the exact answer, which only looks at the lines in nearby cells
+// of a grid index. All queries are const and thread safe.
+class DistanceMap {
+ public:
+  DistanceMap();
+
+  // Build the raster and index for lines. The raster covers the bounding box
+  // of the lines, grown by margin on every side, in cells of resolution
+  // meters.
+  void Build(const std::vector<geometry::line2f>& lines,
+             float resolution,
+             float margin);
+
+  bool Empty() const { return lines_.empty(); }
+
+  // Distance from p to the nearest line according to the raster. It is
+  // within 1.5 times the resolution of the exact distance inside the raster.
+  // Points outside of it get the distance of the nearest raster cell.
+  float ApproximateDistance(const Eigen::Vector2f& p) const;
+
+  // Exact distance from p to the nearest line, or infinity if the map is
+  // empty.
+  float Distance(const Eigen::Vector2f& p) const;
+
+  // Exact distances of num_points points, spread over the threads of pool if
+  // it is not NULL.
+  void Distances(const Eigen::Vector2f* points,
+                 int num_points,
+                 float* distances,
+                 thread_pool::ThreadPool* pool = NULL) const;
+
+  // Exact minimum distance from the segment p0-p1 to any line, which is 0 if
+  // it crosses one, or infinity if the map is empty. This is the clearance of
+  // a point moving along the segment.
+  float SegmentDistance(const Eigen::Vector2f& p0,
+                        const Eigen::Vector2f& p1) const;
+
+  float resolution() const { return resolution_; }
+
+ private:
+  // Raster cell that p is in, or nearest to.
+  int RasterCell(const Eigen::Vector2f& p) const;
+
+  // Upper bound on the distance from p to the nearest line.
+  float DistanceBound(const Eigen::Vector2f& p) const;
+
+  // Exact minimum distance from the segment p0-p1, which may be a point, to
+  // the lines in the index cells within bound of it. The nearest line must
+  // be within bound.
+  float MinDistance(const Eigen::Vector2f& p0,
+                    const Eigen::Vector2f& p1,
+                    float bound) const;
+
+  std::vector<geometry::line2f> lines_;
+
+  // Location of the corner of raster cell (0, 0), which is also the corner
+  // of index cell (0, 0).
+  Eigen::Vector2f origin_;
+  // Size of a raster cell.
+  float resolution_;
+  // Raster dimensions, in cells.
+  int width_;
+  int height_;
+  // Row-major distance of each raster cell's center to the nearest line.
+  std::vector<float> distance_;
+
+  // Index dimensions, in cells.
+  int index_width_;
+  int index_height_;
+  // Lines through each index cell, as the ranges
+  // [index_start_[i], index_start_[i + 1]) of index_lines_.
+  std::vector<int> index_start_;
+  std::vector<int> index_lines_;
+};
+
+}  // namespace vector_map
+
+#endif  // DISTANCE_MAP_H
@@ -0,0 +1,93 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    map_cache.cc
+\brief   Process-wide cache of loaded vector maps.
+*/
+//========================================================================
+
+#include <sys/stat.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "map_cache.h"
+#include "vector_map.h"
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+
+namespace {
+
+// Get the modification time and size of file; both are zero if it does not
+// exist.
+void GetFileStamp(const string& file, time_t* mtime, long* size) {
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0) {
+    *mtime = 0;
+    *size = 0;
+    return;
+  }
+  *mtime = st.st_mtime;
+  *size = st.st_size;
+}
+
+}  // namespace
+
+namespace vector_map {
+
+MapCache& MapCache::Instance() {
+  static MapCache cache;
+  return cache;
+}
+
+shared_ptr<const VectorMap> MapCache::Find(const string& file) {
+  time_t mtime;
+  long size;
+  GetFileStamp(file, &mtime, &size);
+  lock_guard<mutex> lock(mutex_);
+  auto it = entries_.find(file);
+  if (it == entries_.end() ||
+      it->second.mtime != mtime ||
+      it->second.size != size) {
+    return shared_ptr<const VectorMap>();
+  }
+  return it->second.map;
+}
+
+shared_ptr<const VectorMap> MapCache::Load(const string& file) {
+  shared_ptr<const VectorMap> map = Find(file);
+  if (map) return map;
+
+  // Load without holding the lock, so that other maps can be looked up in the
+  // meantime. Two threads loading the same file at once both do the work, and
+  // the last one wins.
+  time_t mtime;
+  long size;
+  GetFileStamp(file, &mtime, &size);
+  map = std::make_shared<const VectorMap>(file);
+
+  lock_guard<mutex> lock(mutex_);
+  Entry& entry = entries_[file];
+  entry.mtime = mtime;
+  entry.size = size;
+  entry.map = map;
+  return map;
+}
+
+}  // namespace vector_map
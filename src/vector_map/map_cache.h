@@ -0,0 +1,67 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    map_cache.h
+\brief   Process-wide cache of loaded vector maps.
+*/
+//========================================================================
+
+#include <time.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "vector_map.h"
+
+#ifndef MAP_CACHE_H
+#define MAP_CACHE_H
+
+namespace vector_map {
+
+// Loaded and cleaned up maps, shared by everything in the process that uses
+// the same map file. An entry is keyed by the file path, and is reloaded when
+// the modification time or size of the file changes. Thread safe.
+class MapCache {
+ public:
+  // The process-wide cache.
+  static MapCache& Instance();
+
+  // Return the map in file, loading it if it is not cached or is out of date.
+  // Loading a large map can take hundreds of ms, so call this from a
+  // background thread when that matters.
+  std::shared_ptr<const VectorMap> Load(const std::string& file);
+
+  // Return the map in file if it is cached and up to date, else NULL. Never
+  // loads the file.
+  std::shared_ptr<const VectorMap> Find(const std::string& file);
+
+ private:
+  struct Entry {
+    time_t mtime;
+    long size;
+    std::shared_ptr<const VectorMap> map;
+  };
+
+  MapCache() {}
+
+  std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+};
+
+}  // namespace vector_map
+
+#endif  // MAP_CACHE_H
@@ -0,0 +1,87 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    map_converter.cc
+\brief   Convert text vector maps to the binary or tiled map formats.
+*/
+//========================================================================
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "shared/util/timer.h"
+#include "vector_map/map_file.h"
+#include "vector_map/tiled_map.h"
+#include "vector_map/vector_map.h"
+
+using std::string;
+using std::vector;
+
+DEFINE_double(tile_size, 0,
+              "If greater than zero, write a tiled map with tiles of this "
+              "size, in meters, to the output directory");
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s [--tile_size=S] input.txt output.vmap|dir\n",
+            argv[0]);
+    return 1;
+  }
+  const string input = argv[1];
+  const string output = argv[2];
+
+  // Loading the text map cleans it up, which is the slow part that the binary
+  // map saves.
+  double t_start = GetMonotonicTime();
+  const vector_map::VectorMap map(input);
+  const double t_text = GetMonotonicTime() - t_start;
+  if (FLAGS_tile_size > 0) {
+    mkdir(output.c_str(), 0755);
+    if (!vector_map::WriteTiledMap(output, FLAGS_tile_size, map.lines)) {
+      return 1;
+    }
+    printf("%s -> %s: %zu lines in tiles of %.1f m\n",
+           input.c_str(), output.c_str(), map.lines.size(), FLAGS_tile_size);
+    return 0;
+  }
+  if (!vector_map::WriteMapFile(output, map.lines,
+                                vector<vector_map::MapFileBlob>())) {
+    return 1;
+  }
+
+  // Check that the binary map loads back to the same lines.
+  t_start = GetMonotonicTime();
+  const vector_map::VectorMap binary_map(output);
+  const double t_binary = GetMonotonicTime() - t_start;
+  bool same = binary_map.lines.size() == map.lines.size();
+  for (size_t i = 0; same && i < map.lines.size(); ++i) {
+    same = binary_map.lines[i].p0 == map.lines[i].p0 &&
+        binary_map.lines[i].p1 == map.lines[i].p1;
+  }
+  if (!same) {
+    fprintf(stderr, "ERROR: %s does not match %s\n",
+            output.c_str(), input.c_str());
+    return 1;
+  }
+  printf("%s -> %s: %zu lines, load %.3f ms -> %.3f ms\n",
+         input.c_str(), output.c_str(), map.lines.size(),
+         1e3 * t_text, 1e3 * t_binary);
+  return 0;
+}
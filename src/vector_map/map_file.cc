@@ -0,0 +1,273 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    map_file.cc
+\brief   Binary vector map file format, for loading maps with mmap.
+*/
+//========================================================================
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/line2d.h"
+#include "map_file.h"
+
+using Eigen::Vector2f;
+using geometry::line2f;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Per-line float sections, in the order they are written.
+const uint32_t kLineSections[] = {
+  vector_map::kMapSectionP0X,
+  vector_map::kMapSectionP0Y,
+  vector_map::kMapSectionP1X,
+  vector_map::kMapSectionP1Y,
+  vector_map::kMapSectionMinX,
+  vector_map::kMapSectionMinY,
+  vector_map::kMapSectionMaxX,
+  vector_map::kMapSectionMaxY,
+};
+const size_t kNumLineSections = sizeof(kLineSections) / sizeof(uint32_t);
+
+uint64_t Align(uint64_t offset) {
+  return (offset + vector_map::kMapFileAlignment - 1) /
+      vector_map::kMapFileAlignment * vector_map::kMapFileAlignment;
+}
+
+// Value of a per-line section for line l.
+float LineValue(uint32_t type, const line2f& l) {
+  switch (type) {
+    case vector_map::kMapSectionP0X: return l.p0.x();
+    case vector_map::kMapSectionP0Y: return l.p0.y();
+    case vector_map::kMapSectionP1X: return l.p1.x();
+    case vector_map::kMapSectionP1Y: return l.p1.y();
+    case vector_map::kMapSectionMinX: return std::min(l.p0.x(), l.p1.x());
+    case vector_map::kMapSectionMinY: return std::min(l.p0.y(), l.p1.y());
+    case vector_map::kMapSectionMaxX: return std::max(l.p0.x(), l.p1.x());
+    case vector_map::kMapSectionMaxY: return std::max(l.p0.y(), l.p1.y());
+  }
+  return 0;
+}
+
+}  // namespace
+
+namespace vector_map {
+
+bool IsMapFile(const string& file) {
+  FILE* fid = fopen(file.c_str(), "rb");
+  if (fid == NULL) return false;
+  char magic[sizeof(kMapFileMagic)];
+  const bool is_map_file =
+      fread(magic, sizeof(magic), 1, fid) == 1 &&
+      memcmp(magic, kMapFileMagic, sizeof(magic)) == 0;
+  fclose(fid);
+  return is_map_file;
+}
+
+bool WriteMapFile(const string& file,
+                  const vector<line2f>& lines,
+                  const vector<MapFileBlob>& extra_sections) {
+  MapFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMapFileMagic, sizeof(header.magic));
+  header.version = kMapFileVersion;
+  header.num_lines = lines.size();
+  header.num_sections = kNumLineSections + extra_sections.size();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const float min_x = std::min(lines[i].p0.x(), lines[i].p1.x());
+    const float min_y = std::min(lines[i].p0.y(), lines[i].p1.y());
+    const float max_x = std::max(lines[i].p0.x(), lines[i].p1.x());
+    const float max_y = std::max(lines[i].p0.y(), lines[i].p1.y());
+    header.min_x = (i == 0) ? min_x : std::min(header.min_x, min_x);
+    header.min_y = (i == 0) ? min_y : std::min(header.min_y, min_y);
+    header.max_x = (i == 0) ? max_x : std::max(header.max_x, max_x);
+    header.max_y = (i == 0) ? max_y : std::max(header.max_y, max_y);
+  }
+
+  // Lay out the sections, each one aligned, after the section table.
+  vector<MapFileSection> sections(header.num_sections);
+  uint64_t offset = Align(sizeof(MapFileHeader) +
+                          sections.size() * sizeof(MapFileSection));
+  for (size_t i = 0; i < sections.size(); ++i) {
+    MapFileSection& section = sections[i];
+    memset(&section, 0, sizeof(section));
+    if (i < kNumLineSections) {
+      section.type = kLineSections[i];
+      section.element_size = sizeof(float);
+      section.size = lines.size() * sizeof(float);
+    } else {
+      const MapFileBlob& blob = extra_sections[i - kNumLineSections];
+      section.type = blob.type;
+      section.element_size = blob.element_size;
+      section.size = blob.data.size();
+    }
+    section.offset = offset;
+    offset = Align(offset + section.size);
+  }
+
+  // Write to a temporary file and rename it over the map, so that processes
+  // that have the old map mapped keep reading it rather than a truncated one.
+  const string temp_file = file + ".tmp";
+  FILE* fid = fopen(temp_file.c_str(), "wb");
+  if (fid == NULL) {
+    fprintf(stderr, "ERROR: Unable to write map %s\n", file.c_str());
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fid) == 1 &&
+      fwrite(sections.data(), sizeof(MapFileSection), sections.size(), fid) ==
+      sections.size();
+  vector<float> values(lines.size());
+  for (size_t i = 0; ok && i < sections.size(); ++i) {
+    // Pad up to the start of the section.
+    static const char kPadding[kMapFileAlignment] = {0};
+    const long position = ftell(fid);
+    ok = position >= 0 &&
+        static_cast<uint64_t>(position) <= sections[i].offset;
+    if (!ok) break;
+    const size_t padding = sections[i].offset - position;
+    ok = padding == 0 || fwrite(kPadding, padding, 1, fid) == 1;
+    if (!ok || sections[i].size == 0) continue;
+    if (i < kNumLineSections) {
+      for (size_t j = 0; j < lines.size(); ++j) {
+        values[j] = LineValue(sections[i].type, lines[j]);
+      }
+      ok = fwrite(values.data(), sizeof(float), values.size(), fid) ==
+          values.size();
+    } else {
+      const string& data = extra_sections[i - kNumLineSections].data;
+      ok = fwrite(data.data(), data.size(), 1, fid) == 1;
+    }
+  }
+  ok = ok && fflush(fid) == 0 && fsync(fileno(fid)) == 0;
+  ok = (fclose(fid) == 0) && ok;
+  ok = ok && rename(temp_file.c_str(), file.c_str()) == 0;
+  if (!ok) {
+    fprintf(stderr, "ERROR: Unable to write map %s\n", file.c_str());
+    unlink(temp_file.c_str());
+  }
+  return ok;
+}
+
+MapFile::MapFile() : data_(NULL), size_(0) {}
+
+MapFile::~MapFile() {
+  Close();
+}
+
+bool MapFile::Open(const string& file) {
+  Close();
+  const int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: Unable to open map %s\n", file.c_str());
+    return false;
+  }
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(MapFileHeader)) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "ERROR: Unable to map %s\n", file.c_str());
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = st.st_size;
+
+  // Check the header and the section table, so that the accessors don't need
+  // to.
+  const MapFileHeader& h = header();
+  const char* error = NULL;
+  if (memcmp(h.magic, kMapFileMagic, sizeof(h.magic)) != 0) {
+    error = "not a binary map file";
+  } else if (h.version != kMapFileVersion) {
+    error = "unsupported version";
+  } else if (sizeof(MapFileHeader) +
+             static_cast<uint64_t>(h.num_sections) * sizeof(MapFileSection) >
+             size_) {
+    error = "truncated section table";
+  }
+  for (uint32_t i = 0; error == NULL && i < h.num_sections; ++i) {
+    const MapFileSection& section = sections()[i];
+    if (section.offset % sizeof(float) != 0 ||
+        section.offset > size_ || section.size > size_ - section.offset) {
+      error = "section out of bounds";
+    }
+  }
+  for (size_t i = 0; error == NULL && i < kNumLineSections; ++i) {
+    uint64_t size = 0;
+    if (Section(kLineSections[i], &size) == NULL ||
+        size != h.num_lines * sizeof(float)) {
+      error = "missing line section";
+    }
+  }
+  if (error != NULL) {
+    fprintf(stderr, "ERROR: Invalid map %s: %s\n", file.c_str(), error);
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MapFile::Close() {
+  if (data_ == NULL) return;
+  munmap(const_cast<uint8_t*>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+const void* MapFile::Section(uint32_t type, uint64_t* size) const {
+  for (uint32_t i = 0; i < header().num_sections; ++i) {
+    const MapFileSection& section = sections()[i];
+    if (section.type != type) continue;
+    if (size != NULL) *size = section.size;
+    return data_ + section.offset;
+  }
+  return NULL;
+}
+
+const float* MapFile::LineSection(uint32_t type) const {
+  uint64_t size = 0;
+  const void* data = Section(type, &size);
+  if (data == NULL || size != num_lines() * sizeof(float)) return NULL;
+  return static_cast<const float*>(data);
+}
+
+void MapFile::GetLines(vector<line2f>* lines) const {
+  const float* p0x = LineSection(kMapSectionP0X);
+  const float* p0y = LineSection(kMapSectionP0Y);
+  const float* p1x = LineSection(kMapSectionP1X);
+  const float* p1y = LineSection(kMapSectionP1Y);
+  lines->resize(num_lines());
+  for (int i = 0; i < num_lines(); ++i) {
+    (*lines)[i].Set(Vector2f(p0x[i], p0y[i]), Vector2f(p1x[i], p1y[i]));
+  }
+}
+
+}  // namespace vector_map
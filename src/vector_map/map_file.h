@@ -0,0 +1,151 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    map_file.h
+\brief   Binary vector map file format, for loading maps with mmap.
+*/
+//========================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "math/line2d.h"
+
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+namespace vector_map {
+
+// A binary map file is a MapFileHeader, followed by a table of num_sections
+// MapFileSection entries, followed by the data of the sections. Each section
+// is an array of plain data in host (little endian) byte order, aligned to
+// kMapFileAlignment bytes, so that the file can be memory mapped and used in
+// place. The lines are stored already cleaned up, so loading them needs no
+// parsing and no VectorMap::Cleanup.
+const char kMapFileMagic[8] = {'V', 'E', 'C', 'M', 'A', 'P', 'B', '\0'};
+const uint32_t kMapFileVersion = 1;
+const size_t kMapFileAlignment = 64;
+
+// Section types. Per-line sections are arrays of num_lines floats.
+enum MapFileSectionType {
+  // Line endpoints.
+  kMapSectionP0X = 1,
+  kMapSectionP0Y = 2,
+  kMapSectionP1X = 3,
+  kMapSectionP1Y = 4,
+  // Types 5 to 7 are unused. Readers skip them in older files that have
+  // them.
+  // Bounding box of each line.
+  kMapSectionMinX = 8,
+  kMapSectionMinY = 9,
+  kMapSectionMaxX = 10,
+  kMapSectionMaxY = 11,
+  // Index of each line of a tile of a tiled map in the whole map, as
+  // uint32_t.
+  kMapSectionTileLineIds = 12,
+  // Serialised spatial indexes and other derived data use types from here
+  // on. Readers skip sections they do not know.
+  kMapSectionIndexBase = 0x100,
+};
+
+struct MapFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_lines;
+  uint32_t num_sections;
+  uint32_t reserved;
+  // Bounding box of the whole map.
+  float min_x;
+  float min_y;
+  float max_x;
+  float max_y;
+};
+
+struct MapFileSection {
+  uint32_t type;
+  // Size of one element of the section's array, in bytes.
+  uint32_t element_size;
+  // Location of the data, in bytes from the start of the file.
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Extra section to write to a map file, such as a serialised index.
+struct MapFileBlob {
+  uint32_t type;
+  uint32_t element_size;
+  std::string data;
+};
+
+// True if file starts with the binary map file magic.
+bool IsMapFile(const std::string& file);
+
+// Write lines, which should already be cleaned up, to file in the binary map
+// format, followed by the extra sections. An existing file is replaced with a
+// rename, leaving any mapping of it intact. Returns false on error.
+bool WriteMapFile(const std::string& file,
+                  const std::vector<geometry::line2f>& lines,
+                  const std::vector<MapFileBlob>& extra_sections);
+
+// Read-only memory mapping of a binary map file. The mapped pages are shared
+// by every process that maps the same file.
+class MapFile {
+ public:
+  MapFile();
+  ~MapFile();
+  MapFile(const MapFile&) = delete;
+  MapFile& operator=(const MapFile&) = delete;
+
+  // Map file, and check that it is a valid binary map. Prints the reason and
+  // returns false if it is not.
+  bool Open(const std::string& file);
+
+  // Unmap the file.
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  const MapFileHeader& header() const {
+    return *reinterpret_cast<const MapFileHeader*>(data_);
+  }
+
+  int num_lines() const { return header().num_lines; }
+
+  // The data of the first section of the given type, or NULL if there is
+  // none. Its size in bytes is returned in size if that is not NULL.
+  const void* Section(uint32_t type, uint64_t* size) const;
+
+  // A per-line float section, or NULL if there is none.
+  const float* LineSection(uint32_t type) const;
+
+  // Copy the lines out of the file.
+  void GetLines(std::vector<geometry::line2f>* lines) const;
+
+ private:
+  const MapFileSection* sections() const {
+    return reinterpret_cast<const MapFileSection*>(data_ +
+                                                   sizeof(MapFileHeader));
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+};
+
+}  // namespace vector_map
+
+#endif  // MAP_FILE_H
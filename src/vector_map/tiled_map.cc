@@ -0,0 +1,275 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    tiled_map.cc
+\brief   Vector maps split into tiles, streamed in around the robot.
+*/
+//========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/line2d.h"
+#include "map_file.h"
+#include "tiled_map.h"
+#include "vector_map.h"
+
+using Eigen::Vector2f;
+using geometry::line2f;
+using std::lock_guard;
+using std::make_pair;
+using std::map;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+
+string TileFileName(const string& dir, int x, int y) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%d_%d.vmap", x, y);
+  return dir + name;
+}
+
+int TileCoordinate(float x, float tile_size) {
+  return static_cast<int>(std::floor(x / tile_size));
+}
+
+}  // namespace
+
+namespace vector_map {
+
+const char kTiledMapIndex[] = "tiles.txt";
+
+bool IsTiledMap(const string& path) {
+  FILE* fid = fopen((path + "/" + kTiledMapIndex).c_str(), "r");
+  if (fid == NULL) return false;
+  fclose(fid);
+  return true;
+}
+
+bool WriteTiledMap(const string& dir,
+                   float tile_size,
+                   const vector<line2f>& lines) {
+  // Put each line in every tile its bounding box overlaps.
+  map<std::pair<int, int>, vector<uint32_t> > tiles;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const line2f& l = lines[i];
+    const int x0 = TileCoordinate(std::min(l.p0.x(), l.p1.x()), tile_size);
+    const int x1 = TileCoordinate(std::max(l.p0.x(), l.p1.x()), tile_size);
+    const int y0 = TileCoordinate(std::min(l.p0.y(), l.p1.y()), tile_size);
+    const int y1 = TileCoordinate(std::max(l.p0.y(), l.p1.y()), tile_size);
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        tiles[make_pair(x, y)].push_back(i);
+      }
+    }
+  }
+
+  const string index_file = dir + "/" + kTiledMapIndex;
+  FILE* fid = fopen(index_file.c_str(), "w");
+  if (fid == NULL) {
+    fprintf(stderr, "ERROR: Unable to write %s\n", index_file.c_str());
+    return false;
+  }
+  fprintf(fid, "%f\n", tile_size);
+  bool ok = true;
+  for (const auto& tile : tiles) {
+    vector<line2f> tile_lines;
+    for (const uint32_t id : tile.second) {
+      tile_lines.push_back(lines[id]);
+    }
+    vector<MapFileBlob> sections(1);
+    sections[0].type = kMapSectionTileLineIds;
+    sections[0].element_size = sizeof(uint32_t);
+    sections[0].data.assign(
+        reinterpret_cast<const char*>(tile.second.data()),
+        tile.second.size() * sizeof(uint32_t));
+    ok = WriteMapFile(TileFileName(dir, tile.first.first, tile.first.second),
+                      tile_lines, sections);
+    if (!ok) break;
+    fprintf(fid, "%d,%d\n", tile.first.first, tile.first.second);
+  }
+  ok = (fclose(fid) == 0) && ok;
+  return ok;
+}
+
+TiledVectorMap::TiledVectorMap() :
+    tile_size_(1),
+    radius_(1),
+    requested_center_(0, 0),
+    has_request_(false),
+    stop_(false),
+    last_center_(0, 0),
+    has_last_center_(false) {}
+
+TiledVectorMap::~TiledVectorMap() {
+  if (!loader_.joinable()) return;
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  request_cv_.notify_one();
+  loader_.join();
+}
+
+bool TiledVectorMap::Open(const string& dir, int radius) {
+  if (loader_.joinable()) {
+    fprintf(stderr, "ERROR: Tiled map %s is already open\n", dir_.c_str());
+    return false;
+  }
+  const string index_file = dir + "/" + kTiledMapIndex;
+  FILE* fid = fopen(index_file.c_str(), "r");
+  if (fid == NULL) {
+    fprintf(stderr, "ERROR: Unable to load tiled map %s\n", dir.c_str());
+    return false;
+  }
+  if (fscanf(fid, "%f", &tile_size_) != 1 || !(tile_size_ > 0)) {
+    fprintf(stderr, "ERROR: Invalid tiled map index %s\n", index_file.c_str());
+    fclose(fid);
+    return false;
+  }
+  int x = 0, y = 0;
+  while (fscanf(fid, "%d,%d", &x, &y) == 2) {
+    tiles_on_disk_.insert(make_pair(x, y));
+  }
+  fclose(fid);
+  dir_ = dir;
+  radius_ = radius;
+  loader_ = std::thread(&TiledVectorMap::Run, this);
+  return true;
+}
+
+void TiledVectorMap::Update(const Vector2f& loc) {
+  const TileKey center(TileCoordinate(loc.x(), tile_size_),
+                       TileCoordinate(loc.y(), tile_size_));
+  if (has_last_center_ && center == last_center_) return;
+  last_center_ = center;
+  has_last_center_ = true;
+  {
+    lock_guard<mutex> lock(mutex_);
+    requested_center_ = center;
+    has_request_ = true;
+  }
+  request_cv_.notify_one();
+}
+
+shared_ptr<const VectorMap> TiledVectorMap::GetView() const {
+  return std::atomic_load(&view_);
+}
+
+bool TiledVectorMap::LoadTile(const TileKey& key, Tile* tile) const {
+  MapFile file;
+  if (!file.Open(TileFileName(dir_, key.first, key.second))) return false;
+  uint64_t size = 0;
+  const uint32_t* ids = static_cast<const uint32_t*>(
+      file.Section(kMapSectionTileLineIds, &size));
+  if (ids == NULL || size != file.num_lines() * sizeof(uint32_t)) {
+    fprintf(stderr, "ERROR: Tile %d,%d of %s has no line ids\n",
+            key.first, key.second, dir_.c_str());
+    return false;
+  }
+  file.GetLines(&tile->lines);
+  tile->ids.assign(ids, ids + file.num_lines());
+  return true;
+}
+
+void TiledVectorMap::PublishView() {
+  // A line in several tiles is only added once, from the first of them.
+  vector<line2f> lines;
+  vector<uint32_t> ids;
+  for (const auto& tile : resident_) {
+    ids.insert(ids.end(), tile.second.ids.begin(), tile.second.ids.end());
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  vector<bool> added(ids.size(), false);
+  lines.reserve(ids.size());
+  for (const auto& tile : resident_) {
+    for (size_t i = 0; i < tile.second.ids.size(); ++i) {
+      const size_t j = std::lower_bound(ids.begin(), ids.end(),
+                                        tile.second.ids[i]) - ids.begin();
+      if (added[j]) continue;
+      added[j] = true;
+      lines.push_back(tile.second.lines[i]);
+    }
+  }
+  shared_ptr<const VectorMap> view = std::make_shared<const VectorMap>(lines);
+  std::atomic_store(&view_, view);
+}
+
+void TiledVectorMap::Run() {
+  while (true) {
+    TileKey center;
+    {
+      unique_lock<mutex> lock(mutex_);
+      request_cv_.wait(lock, [this]() { return has_request_ || stop_; });
+      if (stop_) return;
+      center = requested_center_;
+      has_request_ = false;
+    }
+
+    // Evict tiles that are well outside the radius. The extra tile of slack
+    // keeps a robot driving along a tile border from reloading tiles.
+    bool changed = false;
+    for (auto it = resident_.begin(); it != resident_.end();) {
+      if (abs(it->first.first - center.first) > radius_ + 1 ||
+          abs(it->first.second - center.second) > radius_ + 1) {
+        it = resident_.erase(it);
+        changed = true;
+      } else {
+        ++it;
+      }
+    }
+
+    // Load the missing tiles within the radius.
+    for (int y = center.second - radius_; y <= center.second + radius_; ++y) {
+      for (int x = center.first - radius_; x <= center.first + radius_; ++x) {
+        if (stop_) return;
+        const TileKey key(x, y);
+        if (resident_.count(key) > 0 || tiles_on_disk_.count(key) == 0) {
+          continue;
+        }
+        Tile tile;
+        if (LoadTile(key, &tile)) {
+          resident_[key] = std::move(tile);
+          changed = true;
+        }
+      }
+    }
+
+    // Publish the first view even if there are no tiles here, so that the
+    // map is not left pending.
+    if (changed || !GetView()) {
+      PublishView();
+    }
+  }
+}
+
+}  // namespace vector_map
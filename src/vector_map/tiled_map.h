@@ -0,0 +1,134 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    tiled_map.h
+\brief   Vector maps split into tiles, streamed in around the robot.
+*/
+//========================================================================
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "math/line2d.h"
+#include "map_file.h"
+#include "vector_map.h"
+
+#ifndef TILED_MAP_H
+#define TILED_MAP_H
+
+namespace vector_map {
+
+// A tiled map is a directory with an index file, kTiledMapIndex, and one
+// binary map file per non-empty tile, named "<ix>_<iy>.vmap". The index holds
+// the tile size on its first line, and then the "ix,iy" coordinates of each
+// tile. Tile (ix, iy) covers [ix, ix + 1) x [iy, iy + 1) times the tile size.
+// A line is stored in every tile that its bounding box overlaps, with its
+// index in the whole map in a kMapSectionTileLineIds section, so that it is
+// only used once when the tiles are put back together.
+extern const char kTiledMapIndex[];
+
+// True if path is a tiled map directory.
+bool IsTiledMap(const std::string& path);
+
+// Split lines, which should already be cleaned up, into tiles of tile_size
+// meters, and write them as a tiled map to the directory dir, which must
+// exist. Returns false on error.
+bool WriteTiledMap(const std::string& dir,
+                   float tile_size,
+                   const std::vector<geometry::line2f>& lines);
+
+// A tiled map, of which only the tiles around a location are kept in memory.
+// The tiles are loaded and evicted by a background thread, which publishes a
+// VectorMap of the resident tiles each time they change. Memory use and the
+// size of that map depend only on the tile size and radius, not on the size
+// of the whole map.
+class TiledVectorMap {
+ public:
+  TiledVectorMap();
+  ~TiledVectorMap();
+  TiledVectorMap(const TiledVectorMap&) = delete;
+  TiledVectorMap& operator=(const TiledVectorMap&) = delete;
+
+  // Open the tiled map in dir, and keep the tiles within radius tiles of the
+  // robot's tile resident. Returns false if the index could not be read.
+  bool Open(const std::string& dir, int radius);
+
+  // Move the center of the resident tiles to loc. Only tells the loader
+  // thread, so this never blocks on loading tiles.
+  void Update(const Eigen::Vector2f& loc);
+
+  // The map made of the resident tiles, or NULL until the tiles around the
+  // first Update location have been loaded. Safe to call from any thread.
+  std::shared_ptr<const VectorMap> GetView() const;
+
+  float tile_size() const { return tile_size_; }
+
+ private:
+  typedef std::pair<int, int> TileKey;
+
+  struct Tile {
+    std::vector<geometry::line2f> lines;
+    std::vector<uint32_t> ids;
+  };
+
+  // Loader thread: follow the requested center, loading and evicting tiles.
+  void Run();
+
+  // Load a tile from disk.
+  bool LoadTile(const TileKey& key, Tile* tile) const;
+
+  // Build and publish the map of the resident tiles.
+  void PublishView();
+
+  std::string dir_;
+  float tile_size_;
+  int radius_;
+  // Tiles that exist on disk.
+  std::set<TileKey> tiles_on_disk_;
+
+  // Resident tiles, only used by the loader thread.
+  std::map<TileKey, Tile> resident_;
+
+  // Center tile requested by Update, and the last one passed to the loader.
+  std::mutex mutex_;
+  std::condition_variable request_cv_;
+  TileKey requested_center_;
+  bool has_request_;
+  // Set under mutex_, and also read without it between tile loads, so that
+  // the destructor does not wait for a whole batch of tiles.
+  std::atomic<bool> stop_;
+  TileKey last_center_;
+  bool has_last_center_;
+
+  // Map of the resident tiles, written with atomic stores.
+  std::shared_ptr<const VectorMap> view_;
+
+  std::thread loader_;
+};
+
+}  // namespace vector_map
+
+#endif  // TILED_MAP_H
@@ -20,8 +20,11 @@
 //========================================================================
 
 #include "stdio.h"
+#include <stdint.h>
 
 #include <algorithm>
+#include <cmath>
+#include <set>
 #include <utility>
 #include <vector>
 
@@ -32,11 +35,12 @@
 #include "shared/math/geometry.h"
 #include "shared/math/line2d.h"
 #include "shared/math/math_util.h"
+#include "shared/util/thread_pool.h"
 #include "shared/util/timer.h"
+#include "map_file.h"
 #include "vector_map.h"
 
 using math_util::AngleMod;
-using math_util::RadToDeg;
 using geometry::Cross;
 using geometry::Line;
 using geometry::line2f;
@@ -194,136 +198,405 @@ void TrimOcclusion(const Vector2f& loc,
 }
 
 
-void VectorMap::GetSceneLines(const Vector2f& loc,
-                              float max_range,
-                              vector<line2f>* lines_list) const {
-  const float x_min = loc.x() - max_range;
-  const float y_min = loc.y() - max_range;
-  const float x_max = loc.x() + max_range;
-  const float y_max = loc.y() + max_range;
-  lines_list->clear();
-  for (const line2f& l : lines) {
-    if (l.p0.x() < x_min && l.p1.x() < x_min) continue;
-    if (l.p0.y() < y_min && l.p1.y() < y_min) continue;
-    if (l.p0.x() > x_max && l.p1.x() > x_max) continue;
-    if (l.p0.y() > y_max && l.p1.y() > y_max) continue;
-    lines_list->push_back(l);
+namespace {
+
+// A line segment, relative to the viewpoint of a scene render, oriented
+// counter-clockwise around it, and not crossing the -x axis.
+struct SweepSegment {
+  Vector2f p0;
+  Vector2f p1;
+  // Angles of p0 and p1 around the viewpoint, a0 < a1.
+  float a0;
+  float a1;
+  // Index of the scene line it came from.
+  int line;
+};
+
+// Distance from the viewpoint to segment s along the ray with direction r.
+float RayDistance(const SweepSegment& s, const Vector2f& r) {
+  const Vector2f d = s.p1 - s.p0;
+  return Cross(s.p0, d) / Cross(r, d);
+}
+
+// Point of s on the ray at angle a, using the exact endpoints at its ends.
+Vector2f SweepPoint(const SweepSegment& s, float a) {
+  if (a <= s.a0) return s.p0;
+  if (a >= s.a1) return s.p1;
+  const Vector2f r(cos(a), sin(a));
+  return RayDistance(s, r) * r;
+}
+
+// Orders the segments crossing the sweep ray by their distance along it. The
+// segments do not cross, so their order stays the same while they are both
+// crossing the sweep ray. They are compared halfway between the current sweep
+// angle and the first of their ends, so that segments that share the
+// endpoint at the sweep angle are ordered by where they go next.
+struct SweepOrder {
+  const vector<SweepSegment>* segments;
+  const float* angle;
+  bool operator()(int i, int j) const {
+    const SweepSegment& a = (*segments)[i];
+    const SweepSegment& b = (*segments)[j];
+    const float mid = 0.5f * (*angle + std::min(a.a1, b.a1));
+    const Vector2f r(cos(mid), sin(mid));
+    const float da = RayDistance(a, r);
+    const float db = RayDistance(b, r);
+    // Break ties, including segments seen edge-on, by index, so that no two
+    // segments are equivalent.
+    if (da < db) return true;
+    if (db < da) return false;
+    return i < j;
+  }
+};
+
+struct SweepEvent {
+  float angle;
+  // Ends come before starts at the same angle.
+  bool start;
+  int segment;
+  bool operator<(const SweepEvent& other) const {
+    if (angle != other.angle) return angle < other.angle;
+    return start < other.start;
+  }
+};
+
+// Free list of equally sized nodes, for the active set of the sweep. Freed
+// nodes are kept for reuse, so once the pool has grown to the largest active
+// set, the sweep does not allocate.
+class NodePool {
+ public:
+  NodePool() : node_size_(0), free_(NULL) {}
+  ~NodePool() {
+    for (void* node : nodes_) ::operator delete(node);
+  }
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  void* Allocate(size_t size) {
+    if (node_size_ == 0) node_size_ = size;
+    if (size != node_size_) return ::operator new(size);
+    if (free_ == NULL) {
+      void* node = ::operator new(std::max(size, sizeof(FreeNode)));
+      nodes_.push_back(node);
+      return node;
+    }
+    FreeNode* node = free_;
+    free_ = node->next;
+    return node;
   }
+
+  void Free(void* p, size_t size) {
+    if (size != node_size_) {
+      ::operator delete(p);
+      return;
+    }
+    FreeNode* node = static_cast<FreeNode*>(p);
+    node->next = free_;
+    free_ = node;
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+  size_t node_size_;
+  FreeNode* free_;
+  // Every node the pool has allocated, to be deleted with it.
+  vector<void*> nodes_;
+};
+
+// Allocator of the nodes of a container from a NodePool.
+template <typename T>
+struct PoolAllocator {
+  typedef T value_type;
+  explicit PoolAllocator(NodePool* pool) : pool(pool) {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool->Allocate(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n) { pool->Free(p, n * sizeof(T)); }
+  NodePool* pool;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+  return a.pool == b.pool;
 }
 
-void VectorMap::SceneRender(const Vector2f& loc,
-                            float max_range,
-                            float angle_min,
-                            float angle_max,
-                            vector<line2f>* render) const {
-  static const unsigned int MaxLines = 2000;
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+  return a.pool != b.pool;
+}
+
+typedef std::set<int, SweepOrder, PoolAllocator<int> > ActiveSet;
+
+// Visible part of a segment, as its angular extent.
+struct VisiblePart {
+  int segment;
+  float a0;
+  float a1;
+};
+
+// Angular interval of a visible line, not wrapping around.
+struct LineCast {
+  line2f line;
+  float a0;
+  float a1;
+  bool operator<(const LineCast& other) const { return a0 < other.a0; }
+};
+
+// Temporaries of scene rendering, ray casting and predicted scans. They are
+// kept between calls, so that their capacity is reused.
+struct SceneScratch {
+  // Map lines near the viewpoint, and near a group of viewpoints.
+  vector<line2f> lines;
+  vector<line2f> group_lines;
+  vector<line2f> render;
+  vector<SweepSegment> segments;
+  vector<SweepEvent> events;
+  vector<ActiveSet::iterator> active_it;
+  vector<VisiblePart> visible;
+  vector<LineCast> line_cast;
+  // Nodes of the sweep's active set.
+  NodePool active_nodes;
+  // Batched poses, sorted by the grid cell they are in, and the start of
+  // each cell's group.
+  vector<std::pair<uint64_t, int> > pose_cells;
+  vector<int> groups;
+};
+
+// Render the parts of lines_list that are visible from loc.
+void RenderScene(const Vector2f& loc,
+                 const vector<line2f>& lines_list,
+                 SceneScratch* scratch,
+                 vector<line2f>* render) {
+  // Rotational sweep: the segments are turned into start and end events at
+  // the angles of their endpoints around loc, and swept counter-clockwise
+  // from -pi to pi. Between consecutive events, the part of the nearest
+  // segment crossing the sweep ray is visible.
   const float eps = Sq(FLAGS_min_line_length);
-  vector<line2f> scene;
-  vector<line2f> lines_list;
-  GetSceneLines(loc, max_range, &lines_list);
   render->clear();
 
-  for(size_t i = 0; i < lines_list.size() && i < MaxLines; ++i) {
-    line2f cur_line = lines_list[i];
-    // Check if any part of cur_line is unoccluded by present list of lines,
-    // as seen from loc.
-    for(size_t j = 0; j < scene.size() && cur_line.SqLength() >= eps; ++j) {
-      if (scene[j].SqLength() < eps) continue;
-      TrimOcclusion(loc, scene[j], &cur_line, &lines_list);
+  // Orient the segments counter-clockwise, and split the ones that cross the
+  // -x axis, where the sweep starts and ends. Short lines are ignored, and so
+  // are lines through loc, which are seen edge-on.
+  vector<SweepSegment>& segments = scratch->segments;
+  segments.clear();
+  for (size_t i = 0; i < lines_list.size(); ++i) {
+    const line2f& l = lines_list[i];
+    if (l.SqLength() < eps) continue;
+    SweepSegment s;
+    s.p0 = l.p0 - loc;
+    s.p1 = l.p1 - loc;
+    s.line = i;
+    const float cross = Cross(s.p0, s.p1);
+    if (cross == 0) continue;
+    if (cross < 0) swap(s.p0, s.p1);
+    s.a0 = atan2(s.p0.y(), s.p0.x());
+    s.a1 = atan2(s.p1.y(), s.p1.x());
+    if (s.p0.y() < 0 || s.p1.y() >= 0) {
+      // An end on the -x axis may be at -pi.
+      if (s.a1 < s.a0) s.a1 = M_PI;
+      if (s.a0 < s.a1) segments.push_back(s);
+      continue;
     }
+    // Counter-clockwise from the upper half plane to the lower one, the
+    // segment crosses the -x axis: split it where it does.
+    const Vector2f d = s.p1 - s.p0;
+    const Vector2f q(s.p0.x() - s.p0.y() * d.x() / d.y(), 0);
+    SweepSegment s0 = s;
+    s0.p1 = q;
+    s0.a1 = M_PI;
+    SweepSegment s1 = s;
+    s1.p0 = q;
+    s1.a0 = -M_PI;
+    if (s0.a0 < s0.a1 && s0.p0 != s0.p1) segments.push_back(s0);
+    if (s1.a0 < s1.a1 && s1.p0 != s1.p1) segments.push_back(s1);
+  }
 
-    if (cur_line.SqLength() > eps) { //At least part of cur_line is unoccluded
-      for(size_t j = 0; j < scene.size(); ++j) {
-        if (scene[j].SqLength() < eps) continue;
-        TrimOcclusion(loc, cur_line, &scene[j], &lines_list);
+  vector<SweepEvent>& events = scratch->events;
+  events.resize(2 * segments.size());
+  for (size_t i = 0; i < segments.size(); ++i) {
+    events[2 * i] = {segments[i].a0, true, static_cast<int>(i)};
+    events[2 * i + 1] = {segments[i].a1, false, static_cast<int>(i)};
+  }
+  std::sort(events.begin(), events.end());
+
+  float angle = -M_PI;
+  const SweepOrder order = {&segments, &angle};
+  ActiveSet active(order, PoolAllocator<int>(&scratch->active_nodes));
+  vector<ActiveSet::iterator>& active_it = scratch->active_it;
+  active_it.resize(segments.size());
+  vector<VisiblePart>& visible = scratch->visible;
+  visible.clear();
+  for (size_t i = 0; i < events.size();) {
+    angle = events[i].angle;
+    for (; i < events.size() && events[i].angle == angle; ++i) {
+      const int s = events[i].segment;
+      if (events[i].start) {
+        active_it[s] = active.insert(s).first;
+      } else {
+        active.erase(active_it[s]);
       }
-      // Add the visible part of cur_line.
-      scene.push_back(cur_line);
+    }
+    if (active.empty() || i == events.size()) continue;
+    // The nearest segment is visible until the next event. Consecutive
+    // parts of the same segment are joined.
+    const int nearest = *active.begin();
+    const float next_angle = events[i].angle;
+    if (!visible.empty() && visible.back().segment == nearest &&
+        visible.back().a1 == angle) {
+      visible.back().a1 = next_angle;
+    } else {
+      visible.push_back({nearest, angle, next_angle});
     }
   }
 
-  if (lines_list.size() >= MaxLines) {
-    fprintf(stderr,
-            "Runaway Analytic Scene Render at %.30f,%.30f, %.3f : %.3f\u00b0\n",
-            loc.x(), loc.y(),
-            RadToDeg(angle_min),
-            RadToDeg(angle_max));
-  }
-  for(const line2f& l : scene) {
-    if (l.SqLength() > eps) render->push_back(l);
+  // Slivers narrower than kMinVisibleAngle, such as walls seen through the
+  // gaps that Cleanup leaves at corners, are dropped.
+  const float kMinVisibleAngle = 1e-4;
+  for (size_t i = 0; i < visible.size(); ++i) {
+    const VisiblePart& part = visible[i];
+    const SweepSegment& s = segments[part.segment];
+    const line2f l(loc + SweepPoint(s, part.a0), loc + SweepPoint(s, part.a1));
+    // Join the two halves of a line that was split at the -x axis.
+    if (i > 0 && i + 1 == visible.size() && part.a1 == M_PI &&
+        visible[0].a0 == -M_PI && segments[visible[0].segment].line == s.line &&
+        !render->empty() && (*render)[0].p0 == l.p1) {
+      (*render)[0].p0 = l.p0;
+      continue;
+    }
+    if (part.a1 - part.a0 < kMinVisibleAngle) continue;
+    render->push_back(l);
   }
 }
 
-int GetRayIntersection(const Vector2f& loc,
-                       const size_t skip_line_idx,
-                       const vector<line2f>& lines_list,
-                       Vector2f* ray_end) {
-  Vector2f intersection(0, 0);
-  int intersecting_line_idx = -1;
-  for (size_t i = 0; i < lines_list.size(); ++i) {
-    if (i == skip_line_idx) continue;
-    const line2f& l = lines_list[i];
-    if (l.Intersection(loc, *ray_end, &intersection)) {
-      *ray_end = intersection;
-      intersecting_line_idx = i;
+// Fill scan with the ranges of num_rays rays from loc to the visible lines
+// in render, or range_max for the rays that hit none of them.
+void FillPredictedScan(const Vector2f& loc,
+                       const vector<line2f>& render,
+                       float range_max,
+                       float angle_min,
+                       float angle_max,
+                       int num_rays,
+                       vector<LineCast>* line_cast_ptr,
+                       float* scan) {
+  std::fill(scan, scan + num_rays, range_max);
+  vector<LineCast>& line_cast = *line_cast_ptr;
+  line_cast.clear();
+  for (size_t i = 0; i < render.size(); ++i) {
+    const line2f& r = render[i];
+    LineCast l;
+    l.line.p0 = r.p0 - loc;
+    l.line.p1 = r.p1 - loc;
+    l.a0 = atan2(l.line.p0.y(), l.line.p0.x());
+    l.a1 = atan2(l.line.p1.y(), l.line.p1.x());
+    if (fabs(l.a0 - l.a1) < 0.0001) continue;
+    const bool wraps_around = fabs(l.a1 - l.a0) > M_PI;
+    if ((wraps_around && l.a0 < l.a1) ||
+        (!wraps_around && l.a0 > l.a1)) {
+      swap(l.a0, l.a1);
+      swap(l.line.p0, l.line.p1);
+    }
+    if (wraps_around) {
+      // Split the line into [a0, pi] and [-pi, a1].
+      LineCast l2 = l;
+      l.a1 = M_PI;
+      l2.a0 = -M_PI;
+      line_cast.push_back(l2);
     }
+    line_cast.push_back(l);
+  }
+  if (line_cast.empty()) {
+    return;
   }
-  return intersecting_line_idx;
+  // The visible lines do not overlap in angle, so sorted by angle, each ray
+  // is in the first interval that does not end before it. The ray angles
+  // increase, apart from wrapping around at most once, so the intervals and
+  // rays are swept through together.
+  std::sort(line_cast.begin(), line_cast.end());
+  const float da = (angle_max - angle_min) / static_cast<float>(num_rays);
+  size_t j = 0;
+  float last_angle = -M_PI;
+  for (int i = 0; i < num_rays; ++i) {
+    const float a = AngleMod(angle_min + static_cast<float>(i) * da);
+    if (a < last_angle) j = 0;
+    last_angle = a;
+    while (j < line_cast.size() && line_cast[j].a1 < a) ++j;
+    if (j == line_cast.size()) continue;
+    const LineCast& l = line_cast[j];
+    if (l.a0 <= a) {
+      const Vector2f n = l.line.UnitNormal();
+      const Vector2f r(cos(a), sin(a));
+      scan[i] = n.dot(l.line.p0) / n.dot(r);
+    }
+  }
+}
+
+}  // namespace
+
+struct SceneWorkspace::Buffers : public SceneScratch {};
+
+SceneWorkspace::SceneWorkspace() : buffers_(new Buffers()) {}
+
+SceneWorkspace::~SceneWorkspace() {}
+
+namespace {
+
+// Workspace of the calling thread, for the calls that are not given one.
+SceneWorkspace* ThreadWorkspace() {
+  static thread_local SceneWorkspace workspace;
+  return &workspace;
+}
+
+}  // namespace
+
+void VectorMap::SceneRender(const Vector2f& loc,
+                            float max_range,
+                            float angle_min,
+                            float angle_max,
+                            vector<line2f>* render,
+                            SceneWorkspace* workspace) const {
+  if (workspace == NULL) workspace = ThreadWorkspace();
+  SceneScratch& scratch = *workspace->buffers_;
+  GetSceneLines(loc, max_range, &scratch.lines);
+  RenderScene(loc, scratch.lines, &scratch, render);
 }
 
+
 void VectorMap::RayCast(const Vector2f& loc,
                         float max_range,
-                        vector<line2f>* render) const {
-  static const float kEpsilon = 1e-4;
-
-  // Small optimization: ignore all lines not within max_range.
-  vector<line2f> lines_list;
-  GetSceneLines(loc, max_range, &lines_list);
-
-  // NOTE(joydeep): In this function, "iidx" refers to the index of
-  // the line segment from lines_list that intersects with the associated
-  // ray.
-
-  struct RayCastRay {
-    Vector2f ray_end;
-    int iidx;
-    RayCastRay(const Vector2f& ray_end, int iidx) :
-        ray_end(ray_end), iidx(iidx) {}
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  };
-  // Go through all lines, and check for intersection of rays.
-  vector<RayCastRay> ray_cast_rays;
-  for (size_t i = 0; i < lines_list.size(); ++i) {
-    const line2f& l = lines_list[i];
-    const Vector2f dir = kEpsilon * (l.p1 - l.p0).normalized();
-
-    // Add rays from loc to just inside of the line segment.
-    Vector2f r0 = l.p0 + dir;
-    Vector2f r1 = l.p1 - dir;
-    int r0_iidx = GetRayIntersection(loc, i, lines_list, &r0);
-    int r1_iidx = GetRayIntersection(loc, i, lines_list, &r1);
-    if (r0_iidx < 0) r0_iidx = i;
-    if (r1_iidx < 0) r1_iidx = i;
-    ray_cast_rays.push_back(RayCastRay(r0, r0_iidx));
-    ray_cast_rays.push_back(RayCastRay(r1, r1_iidx));
-
-    // Add rays from loc to max_range just past the line segment.
-    Vector2f end_p0 = loc + (l.p0 - dir - loc).normalized() * max_range;
-    Vector2f end_p1 = loc + (l.p1 + dir - loc).normalized() * max_range;
-    const int end_p0_iidx = GetRayIntersection(loc, i, lines_list, &end_p0);
-    const int end_p1_iidx = GetRayIntersection(loc, i, lines_list, &end_p1);
-    if (end_p0_iidx >= 0) {
-      ray_cast_rays.push_back(RayCastRay(end_p0, end_p0_iidx));
-    }
-    if (end_p1_iidx >= 0) {
-      ray_cast_rays.push_back(RayCastRay(end_p1, end_p1_iidx));
-    }
+                        vector<line2f>* render,
+                        SceneWorkspace* workspace) const {
+  if (workspace == NULL) workspace = ThreadWorkspace();
+  SceneScratch& scratch = *workspace->buffers_;
+  GetSceneLines(loc, max_range, &scratch.lines);
+  RenderScene(loc, scratch.lines, &scratch, &scratch.render);
+
+  // The visible parts do not overlap in angle, so in order of their start
+  // angle, their ends trace the boundary of the visible region. Where one
+  // part ends and the next starts at the same angle, at an occluding corner,
+  // the fan has a ray to each of them.
+  vector<LineCast>& parts = scratch.line_cast;
+  parts.clear();
+  for (const line2f& r : scratch.render) {
+    LineCast l;
+    l.line.p0 = r.p0 - loc;
+    l.line.p1 = r.p1 - loc;
+    if (Cross(l.line.p0, l.line.p1) < 0) swap(l.line.p0, l.line.p1);
+    l.a0 = atan2(l.line.p0.y(), l.line.p0.x());
+    l.a1 = atan2(l.line.p1.y(), l.line.p1.x());
+    parts.push_back(l);
   }
-
-  if (ray_cast_rays.size() < 2) return;
-  for (size_t i = 0; i < ray_cast_rays.size(); ++i) {
-    if (ray_cast_rays[i].ray_end != ray_cast_rays[i - 1].ray_end) {
-      render->push_back(line2f(loc, ray_cast_rays[i].ray_end));
+  std::sort(parts.begin(), parts.end());
+  const size_t start = render->size();
+  for (const LineCast& l : parts) {
+    const Vector2f ends[] = {loc + l.line.p0, loc + l.line.p1};
+    for (const Vector2f& end : ends) {
+      if (render->size() == start || render->back().p1 != end) {
+        render->push_back(line2f(loc, end));
+      }
     }
   }
 }
@@ -337,39 +610,153 @@ void ShrinkLine(float distance, line2f* line) {
   line->p1 -= distance * dir;
 }
 
+namespace {
+
+// Line segments bucketed by a uniform grid over their bounding boxes, so that
+// the segments intersecting a query segment can be found without testing all
+// of them. Any two intersecting segments have overlapping bounding boxes, so
+// they share at least one cell.
+class LineGrid {
+ public:
+  // Set up an empty grid that covers the bounding box of lines, with roughly
+  // as many cells as lines.
+  explicit LineGrid(const vector<line2f>& lines) :
+      origin_(0, 0), cell_size_(1), width_(1), height_(1) {
+    if (lines.empty()) {
+      cells_.resize(1);
+      return;
+    }
+    Vector2f min_corner = lines[0].p0;
+    Vector2f max_corner = lines[0].p0;
+    float total_length = 0;
+    for (const line2f& l : lines) {
+      min_corner = min_corner.cwiseMin(l.p0).cwiseMin(l.p1);
+      max_corner = max_corner.cwiseMax(l.p0).cwiseMax(l.p1);
+      total_length += l.Length();
+    }
+    // Cells about as large as the average line, but not so small that the
+    // grid has many more cells than there are lines.
+    const Vector2f size = max_corner - min_corner;
+    const float kMaxCellsPerLine = 4;
+    cell_size_ = std::max(
+        total_length / static_cast<float>(lines.size()),
+        std::sqrt(size.x() * size.y() /
+                  (kMaxCellsPerLine * static_cast<float>(lines.size()))));
+    if (!(cell_size_ > 0)) cell_size_ = 1;
+    origin_ = min_corner;
+    width_ = static_cast<int>(size.x() / cell_size_) + 1;
+    height_ = static_cast<int>(size.y() / cell_size_) + 1;
+    cells_.resize(width_ * height_);
+  }
+
+  // Add a line, with the next index.
+  void Insert(const line2f& l) {
+    const int index = lines_.size();
+    lines_.push_back(l);
+    int x0, y0, x1, y1;
+    GetCellRange(l, &x0, &y0, &x1, &y1);
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        cells_[y * width_ + x].push_back(index);
+      }
+    }
+  }
+
+  // Find the first inserted line that intersects l, and the point where it
+  // does, as computed by line2f::Intersection. Returns -1 if there is none.
+  int FirstIntersection(const line2f& l, Vector2f* intersection) const {
+    int x0, y0, x1, y1;
+    GetCellRange(l, &x0, &y0, &x1, &y1);
+    int first = -1;
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        // Each cell lists its lines in insertion order, so only the first
+        // one that intersects can beat the best so far.
+        for (const int index : cells_[y * width_ + x]) {
+          if (first >= 0 && index >= first) break;
+          Vector2f p;
+          if (lines_[index].Intersection(l, &p)) {
+            first = index;
+            *intersection = p;
+            break;
+          }
+        }
+      }
+    }
+    return first;
+  }
+
+  // All inserted lines, in insertion order.
+  vector<line2f>& lines() { return lines_; }
+
+ private:
+  // Range of cells covered by the bounding box of l, clamped to the grid.
+  void GetCellRange(const line2f& l, int* x0, int* y0, int* x1, int* y1) const {
+    *x0 = GetCell(std::min(l.p0.x(), l.p1.x()) - origin_.x(), width_);
+    *x1 = GetCell(std::max(l.p0.x(), l.p1.x()) - origin_.x(), width_);
+    *y0 = GetCell(std::min(l.p0.y(), l.p1.y()) - origin_.y(), height_);
+    *y1 = GetCell(std::max(l.p0.y(), l.p1.y()) - origin_.y(), height_);
+  }
+
+  int GetCell(float offset, int num_cells) const {
+    const float cell = std::floor(offset / cell_size_);
+    if (cell < 0) return 0;
+    if (cell >= num_cells) return num_cells - 1;
+    return static_cast<int>(cell);
+  }
+
+  Vector2f origin_;
+  float cell_size_;
+  int width_;
+  int height_;
+  vector<vector<int> > cells_;
+  vector<line2f> lines_;
+};
+
+}  // namespace
+
 void VectorMap::Cleanup() {
   const float kShrinkDistance = 1e-4;
   // const float kMinLineLength = 2.0 * kShrinkDistance;
   const float kMinLineLength = 0.05;
-  vector<line2f> new_lines;
+  // Lines are split at the first kept line they intersect, in the order the
+  // lines were kept. The grid finds that line without testing every kept
+  // line. The pieces of a split line lie within the line's bounding box, so
+  // the grid covers them too.
+  LineGrid new_lines(lines);
   for (size_t i = 0; i < lines.size(); ++i) {
-    const line2f& l1 = lines[i];
+    const line2f l1 = lines[i];
     if (l1.Length() < kMinLineLength) continue;
     // Check if l1 intersects with any line in new lines.
     Vector2f p;
-    bool intersection = false;
-    for (const line2f l2 : new_lines) {
-      if (l2.Intersection(l1, &p)) {
-        const Vector2f shrink = kShrinkDistance * l1.Dir();
-        const line2f a = line2f(l1.p0, p - shrink);
-        const line2f b = line2f(p + shrink, l1.p1);
-        lines.push_back(a);
-        lines.push_back(b);
-        intersection = true;
-        break;
-      }
+    if (new_lines.FirstIntersection(l1, &p) >= 0) {
+      const Vector2f shrink = kShrinkDistance * l1.Dir();
+      lines.push_back(line2f(l1.p0, p - shrink));
+      lines.push_back(line2f(p + shrink, l1.p1));
+    } else {
+      // No intersection, add it!
+      new_lines.Insert(l1);
     }
-    // No intersection, add it!
-    if (!intersection) new_lines.push_back(l1);
   }
 
-  for (line2f& l : new_lines) {
+  for (line2f& l : new_lines.lines()) {
     ShrinkLine(kShrinkDistance, &l);
   }
-  lines = new_lines;
+  lines.swap(new_lines.lines());
 }
 
 void VectorMap::Load(const string& file) {
+  // Binary maps are already cleaned up, and are copied straight out of the
+  // mapped file.
+  if (IsMapFile(file)) {
+    MapFile map_file;
+    if (!map_file.Open(file)) {
+      exit(1);
+    }
+    map_file.GetLines(&lines);
+    file_name = file;
+    return;
+  }
   FILE* fid = fopen(file.c_str(), "r");
   if (fid == NULL) {
     fprintf(stderr, "ERROR: Unable to load map %s\n", file.c_str());
@@ -385,70 +772,86 @@ void VectorMap::Load(const string& file) {
   file_name = file;
 }
 
-bool VectorMap::Intersects(const Vector2f& v0, const Vector2f& v1) const {
-  for (const line2f& l : lines) {
-    if (l.Intersects(v0, v1)) return true;
-  }
-  return false;
-}
-
 void VectorMap::GetPredictedScan(const Vector2f& loc,
                                  float range_min,
                                  float range_max,
                                  float angle_min,
                                  float angle_max,
                                  int num_rays,
-                                 vector<float>* scan_ptr) {
+                                 vector<float>* scan_ptr,
+                                 SceneWorkspace* workspace) const {
   static CumulativeFunctionTimer function_timer_(__FUNCTION__);
   CumulativeFunctionTimer::Invocation invoke(&function_timer_);
-  vector<float>& scan = *scan_ptr;
-  vector<line2f> raycast;
-  SceneRender(loc, range_max, angle_min, angle_max, &raycast);
-  scan.resize(num_rays);
-  std::fill(scan.begin(), scan.end(), range_max);
-  if (raycast.empty()) {
-    return;
+  if (workspace == NULL) workspace = ThreadWorkspace();
+  SceneScratch& scratch = *workspace->buffers_;
+  GetSceneLines(loc, range_max, &scratch.lines);
+  RenderScene(loc, scratch.lines, &scratch, &scratch.render);
+  scan_ptr->resize(num_rays);
+  FillPredictedScan(loc, scratch.render, range_max, angle_min, angle_max,
+                    num_rays, &scratch.line_cast, scan_ptr->data());
+}
+
+void VectorMap::GetPredictedScans(const Eigen::Vector3f* poses,
+                                  int num_poses,
+                                  float range_max,
+                                  float angle_min,
+                                  float angle_max,
+                                  int num_rays,
+                                  ScanMatrix* scans,
+                                  thread_pool::ThreadPool* pool) const {
+  // Poses in the same cell of this grid share the culling of the map lines.
+  const float kCellSize = 1.0;
+  scans->resize(num_poses, num_rays);
+  SceneScratch& scratch = *ThreadWorkspace()->buffers_;
+  vector<std::pair<uint64_t, int> >& pose_cells = scratch.pose_cells;
+  pose_cells.resize(num_poses);
+  for (int i = 0; i < num_poses; ++i) {
+    const uint32_t x = static_cast<int32_t>(floor(poses[i].x() / kCellSize));
+    const uint32_t y = static_cast<int32_t>(floor(poses[i].y() / kCellSize));
+    pose_cells[i] = std::make_pair((static_cast<uint64_t>(x) << 32) | y, i);
   }
-  struct LineCast {
-    line2f line;
-    float a0;
-    float a1;
-    bool wraps_around;
-  };
-  vector<LineCast> line_cast;
-  for (size_t i = 0; i < raycast.size(); ++i) {
-    const line2f& r = raycast[i];
-    LineCast l;
-    l.line.p0 = r.p0 - loc;
-    l.line.p1 = r.p1 - loc;
-    l.a0 = atan2(l.line.p0.y(), l.line.p0.x());
-    l.a1 = atan2(l.line.p1.y(), l.line.p1.x());
-    if (fabs(l.a0 - l.a1) < 0.0001) continue;
-    l.wraps_around = fabs(l.a1 - l.a0) > M_PI;
-    if ((l.wraps_around && l.a0 < l.a1) ||
-        (!l.wraps_around && l.a0 > l.a1)) {
-      swap(l.a0, l.a1);
-      swap(l.line.p0, l.line.p1);
+  std::sort(pose_cells.begin(), pose_cells.end());
+  vector<int>& groups = scratch.groups;
+  groups.clear();
+  for (int i = 0; i < num_poses; ++i) {
+    if (i == 0 || pose_cells[i].first != pose_cells[i - 1].first) {
+      groups.push_back(i);
     }
-    line_cast.push_back(l);
   }
-  if (line_cast.empty()) {
-    return;
-  }
-  // Iterate over the ray cast, filling the angles
-  scan.resize(num_rays);
-  const float da = (angle_max - angle_min) / static_cast<float>(num_rays);
-  for (int i = 0; i < num_rays; ++i) {
-    const float a = AngleMod(angle_min + static_cast<float>(i) * da);
-    for (const LineCast& l : line_cast) {
-      if ((!l.wraps_around && l.a0 <= a && l.a1 >= a) ||
-          (l.wraps_around && (l.a0 <= a || l.a1 >= a))) {
-        const Vector2f n = l.line.UnitNormal();
-        const Vector2f r(cos(a), sin(a));
-        scan[i] = n.dot(l.line.p0) / n.dot(r);
-        break;
-      }
+  groups.push_back(num_poses);
+
+  const auto render_group = [&](int group) {
+    SceneScratch& thread_scratch = *ThreadWorkspace()->buffers_;
+    const int begin = groups[group];
+    const int end = groups[group + 1];
+    // A box of range_max around any pose in the cell is within a box of
+    // range_max plus half the cell around the cell's center, so culling the
+    // group's lines again for each pose gives the same lines, in the same
+    // order, as culling the whole map.
+    const Eigen::Vector3f& first_pose = poses[pose_cells[begin].second];
+    const Vector2f center(
+        (floor(first_pose.x() / kCellSize) + 0.5f) * kCellSize,
+        (floor(first_pose.y() / kCellSize) + 0.5f) * kCellSize);
+    GetSceneLines(center, range_max + 0.5f * kCellSize,
+                  &thread_scratch.group_lines);
+    for (int i = begin; i < end; ++i) {
+      const int pose = pose_cells[i].second;
+      const Vector2f loc = poses[pose].head<2>();
+      const float angle = poses[pose].z();
+      CullLines(thread_scratch.group_lines, loc, range_max,
+                &thread_scratch.lines);
+      RenderScene(loc, thread_scratch.lines, &thread_scratch,
+                  &thread_scratch.render);
+      FillPredictedScan(loc, thread_scratch.render, range_max,
+                        angle + angle_min, angle + angle_max, num_rays,
+                        &thread_scratch.line_cast, scans->row(pose).data());
     }
+  };
+  const int num_groups = groups.size() - 1;
+  if (pool == NULL) {
+    for (int i = 0; i < num_groups; ++i) render_group(i);
+  } else {
+    pool->ParallelFor(num_groups, render_group);
   }
 }
 
@@ -19,17 +19,27 @@
 */
 //========================================================================
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "eigen3/Eigen/Dense"
 #include "math/line2d.h"
+#include "basic_vector_map.h"
 
 #ifndef VECTOR_MAP_H
 #define VECTOR_MAP_H
 
+namespace thread_pool {
+class ThreadPool;
+}  // namespace thread_pool
+
 namespace vector_map {
 
+// Predicted scans of several poses, one row per pose.
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    ScanMatrix;
+
 // Checks if any part of trim_line is occluded by test_line when seen from
 // loc, and if so, trim_line is trimmed accordingly, adding sub-lines to
 // scene_lines if necessary.
@@ -38,28 +48,52 @@ void TrimOcclusion(const Eigen::Vector2f& loc,
                   geometry::line2f* line2_ptr,
                   std::vector<geometry::line2f>* scene_lines_ptr);
 
-struct VectorMap {
+struct VectorMap;
+
+// Reusable temporaries of SceneRender, RayCast and GetPredictedScan. Their
+// buffers keep their capacity between calls, so once they have grown to fit
+// the scenes of a map, those calls do not allocate. A workspace must only be
+// used by one thread at a time. Calls that are not given a workspace use one
+// that belongs to the calling thread.
+class SceneWorkspace {
+ public:
+  SceneWorkspace();
+  ~SceneWorkspace();
+
+ private:
+  friend struct VectorMap;
+  struct Buffers;
+  std::unique_ptr<Buffers> buffers_;
+};
+
+// Vector map in float coordinates, with the queries that work on angles
+// around a viewpoint, which are rendered in floating point.
+struct VectorMap : public BasicVectorMap<float> {
   VectorMap() {}
   explicit VectorMap(const std::vector<geometry::line2f>& lines) :
-      lines(lines) {}
+      BasicVectorMap<float>(lines) {}
   explicit VectorMap(const std::string& file) {
     Load(file);
   }
 
-  void GetSceneLines(const Eigen::Vector2f& loc,
-                     float max_range,
-                     std::vector<geometry::line2f>* lines_list) const;
-
 
+  // Get the parts of the lines within max_range of loc that are visible from
+  // loc, all the way around it. angle_min and angle_max are not used.
   void SceneRender(const Eigen::Vector2f& loc,
                    float max_range,
                    float angle_min,
                    float angle_max,
-                   std::vector<geometry::line2f>* render) const;
+                   std::vector<geometry::line2f>* render,
+                   SceneWorkspace* workspace = NULL) const;
 
+  // Append to render the fan of rays from loc to the ends of the parts of the
+  // lines within max_range that are visible from loc, counter-clockwise, so
+  // that consecutive rays bound the visible region. At an occluding corner,
+  // there is a ray to the corner and one to the line behind it.
   void RayCast(const Eigen::Vector2f& loc,
                float max_range,
-               std::vector<geometry::line2f>* render) const;
+               std::vector<geometry::line2f>* render,
+               SceneWorkspace* workspace = NULL) const;
 
   // Get predicted laser scan from current location.
   void GetPredictedScan(const Eigen::Vector2f& loc,
@@ -68,13 +102,29 @@ struct VectorMap {
                         float angle_min,
                         float angle_max,
                         int num_rays,
-                        std::vector<float>* scan);
+                        std::vector<float>* scan,
+                        SceneWorkspace* workspace = NULL) const;
+
+  // Get the predicted laser scans of num_poses poses (x, y, angle), as the
+  // rows of scans. angle_min and angle_max are relative to each pose's angle.
+  // Each row is the same as GetPredictedScan would give for its pose. Poses
+  // close to each other share the culling of the map lines, and if pool is
+  // not NULL, they are spread over its threads. This is thread safe, and
+  // uses the workspaces of the threads it runs on.
+  void GetPredictedScans(const Eigen::Vector3f* poses,
+                         int num_poses,
+                         float range_max,
+                         float angle_min,
+                         float angle_max,
+                         int num_rays,
+                         ScanMatrix* scans,
+                         thread_pool::ThreadPool* pool = NULL) const;
   void Cleanup();
 
+  // Load a map in either the text format, one "x0,y0,x1,y1" line per line
+  // segment, or the binary format of map_file.h, detected from the file.
   void Load(const std::string& file);
 
-  bool Intersects(const Eigen::Vector2f& v0, const Eigen::Vector2f& v1) const ;
-  std::vector<geometry::line2f> lines;
   std::string file_name;
 };
 
@@ -0,0 +1,144 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    vector_map_benchmark.cc
+\brief   Throughput of the vector map queries with float, double and fixed
+         point coordinates
+*/
+//========================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "gflags/gflags.h"
+#include "shared/math/line2d.h"
+#include "shared/util/random.h"
+#include "shared/util/timer.h"
+#include "basic_vector_map.h"
+
+using Eigen::Vector2d;
+using geometry::line2d;
+using std::vector;
+using vector_map::BasicVectorMap;
+using vector_map::MapScalar;
+
+DEFINE_string(map, "maps/GDC3.txt", "Name of the text vector map file");
+DEFINE_double(offset,
+              0,
+              "Distance to move the map away from the origin along x and y, "
+              "to show the loss of float precision far from zero");
+DEFINE_int32(queries, 100000, "Number of random queries of each kind");
+DEFINE_double(segment_length, 2, "Length of the random query segments");
+DEFINE_double(range, 10, "Range of the scene line queries");
+
+// Query segments, in meters, spread over the bounding box of the map.
+struct Queries {
+  vector<Vector2d> p0;
+  vector<Vector2d> p1;
+};
+
+// Time the queries on map, converted from the double precision map, and
+// count how many of the intersection tests disagree with it.
+template <typename T>
+void RunBenchmark(const char* name,
+                  const BasicVectorMap<double>& map_double,
+                  const Queries& queries,
+                  const vector<bool>& expected) {
+  typedef Eigen::Matrix<T, 2, 1> Vector2T;
+  const BasicVectorMap<T> map(map_double);
+  const int n = queries.p0.size();
+  vector<Vector2T> p0(n);
+  vector<Vector2T> p1(n);
+  for (int i = 0; i < n; ++i) {
+    p0[i] = Vector2T(MapScalar<T>::FromMeters(queries.p0[i].x()),
+                     MapScalar<T>::FromMeters(queries.p0[i].y()));
+    p1[i] = Vector2T(MapScalar<T>::FromMeters(queries.p1[i].x()),
+                     MapScalar<T>::FromMeters(queries.p1[i].y()));
+  }
+
+  double t_start = GetMonotonicTime();
+  int disagreements = 0;
+  for (int i = 0; i < n; ++i) {
+    if (map.Intersects(p0[i], p1[i]) != expected[i]) ++disagreements;
+  }
+  const double t_intersects = GetMonotonicTime() - t_start;
+
+  const T range = MapScalar<T>::FromMeters(FLAGS_range);
+  vector<geometry::Line<T> > lines;
+  size_t num_lines = 0;
+  t_start = GetMonotonicTime();
+  for (int i = 0; i < n; ++i) {
+    map.GetSceneLines(p0[i], range, &lines);
+    num_lines += lines.size();
+  }
+  const double t_scene = GetMonotonicTime() - t_start;
+
+  printf("%-8s Intersects: %8.3f Mqueries/s, %d disagree with double; "
+         "GetSceneLines: %8.3f Mqueries/s, %.1f lines each\n",
+         name,
+         1e-6 * n / t_intersects,
+         disagreements,
+         1e-6 * n / t_scene,
+         static_cast<double>(num_lines) / n);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, false);
+
+  BasicVectorMap<double> map;
+  if (!map.LoadLines(FLAGS_map)) {
+    fprintf(stderr, "ERROR: Unable to load map %s\n", FLAGS_map.c_str());
+    return 1;
+  }
+  if (map.lines.empty()) {
+    fprintf(stderr, "ERROR: Map %s has no lines\n", FLAGS_map.c_str());
+    return 1;
+  }
+  const Vector2d offset(FLAGS_offset, FLAGS_offset);
+  Vector2d box_min = map.lines[0].p0 + offset;
+  Vector2d box_max = box_min;
+  for (line2d& l : map.lines) {
+    l.p0 += offset;
+    l.p1 += offset;
+    box_min = box_min.cwiseMin(l.p0).cwiseMin(l.p1);
+    box_max = box_max.cwiseMax(l.p0).cwiseMax(l.p1);
+  }
+
+  util_random::Random rng(1);
+  Queries queries;
+  vector<bool> expected;
+  for (int i = 0; i < FLAGS_queries; ++i) {
+    const Vector2d p0(rng.UniformRandom(box_min.x(), box_max.x()),
+                      rng.UniformRandom(box_min.y(), box_max.y()));
+    const double angle = rng.UniformRandom(-M_PI, M_PI);
+    const Vector2d p1 =
+        p0 + FLAGS_segment_length * Vector2d(cos(angle), sin(angle));
+    queries.p0.push_back(p0);
+    queries.p1.push_back(p1);
+    expected.push_back(map.Intersects(p0, p1));
+  }
+
+  printf("Map: %s, %zu lines, offset %.1f m, %d queries\n",
+         FLAGS_map.c_str(), map.lines.size(), FLAGS_offset, FLAGS_queries);
+  RunBenchmark<float>("float", map, queries, expected);
+  RunBenchmark<double>("double", map, queries, expected);
+  RunBenchmark<int32_t>("fixed", map, queries, expected);
+  return 0;
+}
@@ -0,0 +1,179 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    vector_map_test.cc
+\brief   Checks that scene rendering and predicted scans do not allocate
+         once their workspaces have grown, and that distance queries are
+         exact
+*/
+//========================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "eigen3/Eigen/Dense"
+#include "shared/math/geometry.h"
+#include "shared/math/line2d.h"
+#include "shared/util/heap_counter.h"
+#include "shared/util/random.h"
+#include "vector_map/distance_map.h"
+#include "vector_map/vector_map.h"
+
+using Eigen::Vector2f;
+using Eigen::Vector3f;
+using geometry::line2f;
+using std::vector;
+using vector_map::SceneWorkspace;
+using vector_map::VectorMap;
+
+const float kRangeMin = 0.02;
+const float kRangeMax = 10.0;
+const float kAngleMin = -2.356;
+const float kAngleMax = 2.356;
+const int kNumRays = 1081;
+
+// A grid of square rooms, with a door in each wall, and a few pillars.
+VectorMap MakeMap() {
+  const float kRoomSize = 4;
+  const float kDoorWidth = 1;
+  const int kNumRooms = 6;
+  vector<line2f> lines;
+  for (int i = 0; i <= kNumRooms; ++i) {
+    for (int j = 0; j < kNumRooms; ++j) {
+      const float a = i * kRoomSize;
+      const float b0 = j * kRoomSize;
+      const float b1 = b0 + 0.5f * (kRoomSize - kDoorWidth);
+      const float b2 = b1 + kDoorWidth;
+      const float b3 = b0 + kRoomSize;
+      lines.push_back(line2f(a, b0, a, b1));
+      lines.push_back(line2f(a, b2, a, b3));
+      lines.push_back(line2f(b0, a, b1, a));
+      lines.push_back(line2f(b2, a, b3, a));
+    }
+  }
+  for (int i = 0; i < kNumRooms; ++i) {
+    const Vector2f c(kRoomSize * (i + 0.3f), kRoomSize * (i + 0.6f));
+    lines.push_back(line2f(c.x(), c.y(), c.x() + 0.3f, c.y()));
+    lines.push_back(line2f(c.x() + 0.3f, c.y(), c.x() + 0.3f, c.y() + 0.3f));
+  }
+  return VectorMap(lines);
+}
+
+// Every scene query, once for each pose.
+void QueryScenes(const VectorMap& map,
+                 const vector<Vector3f>& poses,
+                 SceneWorkspace* workspace,
+                 vector<line2f>* lines,
+                 vector<float>* scan,
+                 vector_map::ScanMatrix* scans) {
+  for (const Vector3f& pose : poses) {
+    const Vector2f loc = pose.head<2>();
+    map.GetSceneLines(loc, kRangeMax, lines);
+    lines->clear();
+    map.SceneRender(loc, kRangeMax, 0, 0, lines, workspace);
+    lines->clear();
+    map.RayCast(loc, kRangeMax, lines, workspace);
+    map.GetPredictedScan(loc, kRangeMin, kRangeMax,
+                         pose.z() + kAngleMin, pose.z() + kAngleMax,
+                         kNumRays, scan, workspace);
+  }
+  map.GetPredictedScans(poses.data(), poses.size(), kRangeMax,
+                        kAngleMin, kAngleMax, kNumRays, scans);
+}
+
+int main() {
+  const VectorMap map = MakeMap();
+  util_random::Random rng(1);
+  vector<Vector3f> poses(200);
+  for (Vector3f& pose : poses) {
+    pose = Vector3f(rng.UniformRandom(0.5, 23.5),
+                    rng.UniformRandom(0.5, 23.5),
+                    rng.UniformRandom(-M_PI, M_PI));
+  }
+  SceneWorkspace workspace;
+  vector<line2f> lines;
+  vector<float> scan;
+  vector_map::ScanMatrix scans;
+  int failures = 0;
+  // Warm up with the same poses, once with the explicit workspace and once
+  // with the calling thread's, then check that neither allocates again.
+  SceneWorkspace* const workspaces[] = {&workspace, NULL};
+  for (SceneWorkspace* w : workspaces) {
+    QueryScenes(map, poses, w, &lines, &scan, &scans);
+    const uint64_t start = heap_counter::NumAllocations();
+    QueryScenes(map, poses, w, &lines, &scan, &scans);
+    const uint64_t allocations = heap_counter::NumAllocations() - start;
+    const bool pass = (allocations == 0);
+    printf("%s: %lu allocations in %zu steady state queries with %s "
+           "workspace\n",
+           pass ? "PASS" : "FAIL",
+           static_cast<unsigned long>(allocations),
+           poses.size(),
+           (w == NULL) ? "the thread's" : "an explicit");
+    if (!pass) ++failures;
+  }
+
+  // The batched scans match the single ones.
+  int mismatches = 0;
+  for (size_t i = 0; i < poses.size(); ++i) {
+    map.GetPredictedScan(poses[i].head<2>(), kRangeMin, kRangeMax,
+                         poses[i].z() + kAngleMin, poses[i].z() + kAngleMax,
+                         kNumRays, &scan, &workspace);
+    for (int j = 0; j < kNumRays; ++j) {
+      if (scans(i, j) != scan[j]) ++mismatches;
+    }
+  }
+  printf("%s: %d of %zu batched ranges differ from single scans\n",
+         (mismatches == 0) ? "PASS" : "FAIL",
+         mismatches,
+         poses.size() * kNumRays);
+  if (mismatches != 0) ++failures;
+
+  // Distance queries match brute force over all of the lines.
+  vector_map::DistanceMap distance_map;
+  distance_map.Build(map.lines, 0.1, 1.0);
+  vector<Vector2f> points(poses.size());
+  for (size_t i = 0; i < poses.size(); ++i) {
+    // Some of the points are outside of the raster.
+    points[i] = 1.5f * poses[i].head<2>() - Vector2f(6, 6);
+  }
+  vector<float> distances(points.size());
+  distance_map.Distances(points.data(), points.size(), distances.data());
+  mismatches = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    const Vector2f& p = points[i];
+    const Vector2f& q = points[(i + 1) % points.size()];
+    float point_distance = 1e30;
+    float segment_distance = 1e30;
+    for (const line2f& l : map.lines) {
+      point_distance = std::min(point_distance, (p -
+          geometry::ProjectPointOntoLineSegment(p, l.p0, l.p1)).norm());
+      segment_distance = std::min(segment_distance,
+          geometry::MinDistanceLineLine(p, q, l.p0, l.p1));
+    }
+    if (distances[i] != point_distance) ++mismatches;
+    if (distance_map.SegmentDistance(p, q) != segment_distance) ++mismatches;
+  }
+  printf("%s: %d of %zu distances differ from brute force\n",
+         (mismatches == 0) ? "PASS" : "FAIL",
+         mismatches,
+         2 * points.size());
+  if (mismatches != 0) ++failures;
+  return (failures == 0) ? 0 : 1;
+}